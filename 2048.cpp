@@ -11,21 +11,31 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <csignal>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistic.h"
+#include "trainer.h"
+#include "checkpoint.h"
+
+static volatile std::sig_atomic_t interrupted = 0;
 
 int main(int argc, const char* argv[]) {
 	std::cout << "2048-Demo: ";
 	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
 	std::cout << std::endl << std::endl;
 
-	size_t total = 1000, block = 0, limit = 0;
-	std::string play_args, evil_args;
+	size_t total = 1000, block = 0, limit = 0, thread = 0, shard = 0, epoch = 0, interval = 0;
+	std::string play_args, evil_args, eval_args, start_args, pipeline;
 	std::string load, save;
-	bool summary = false;
+	std::string schedule, resume, serve;
+	std::vector<std::string> replay;
+	bool summary = false, resuming = false, deterministic = false;
 	for (int i = 1; i < argc; i++) {
 		std::string para(argv[i]);
 		if (para.find("--total=") == 0) {
@@ -38,15 +48,55 @@ int main(int argc, const char* argv[]) {
 			play_args = para.substr(para.find("=") + 1);
 		} else if (para.find("--evil=") == 0) {
 			evil_args = para.substr(para.find("=") + 1);
+		} else if (para.find("--start=") == 0) {
+			start_args = para.substr(para.find("=") + 1);
+		} else if (para.find("--eval=") == 0) {
+			eval_args = para.substr(para.find("=") + 1);
 		} else if (para.find("--load=") == 0) {
 			load = para.substr(para.find("=") + 1);
 		} else if (para.find("--save=") == 0) {
 			save = para.substr(para.find("=") + 1);
+		} else if (para.find("--thread=") == 0) {
+			thread = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--shard=") == 0) {
+			shard = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--deterministic") == 0) {
+			deterministic = true;
+			if (para.find("=") != std::string::npos) epoch = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--pipeline=") == 0) {
+			pipeline = para.substr(para.find("=") + 1);
+		} else if (para.find("--replay=") == 0) {
+			std::stringstream files(para.substr(para.find("=") + 1));
+			for (std::string file; std::getline(files, file, ','); ) replay.push_back(file);
+		} else if (para.find("--schedule=") == 0) {
+			schedule = para.substr(para.find("=") + 1);
+		} else if (para.find("--checkpoint=") == 0) {
+			resume = para.substr(para.find("=") + 1);
+		} else if (para.find("--checkpoint_interval=") == 0) {
+			interval = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--resume") == 0) {
+			resuming = true;
+		} else if (para.find("--serve=") == 0) {
+			serve = para.substr(para.find("=") + 1);
 		} else if (para.find("--summary") == 0) {
 			summary = true;
 		}
 	}
 
+	std::vector<checkpoint::stage> plan = checkpoint::schedule(schedule);
+	if (plan.size()) {
+		total = 0;
+		for (const checkpoint::stage& run : plan) total += run.games;
+	} else {
+		plan.push_back({ "", total, "" });
+	}
+
+	checkpoint ckpt;
+	resuming = resuming && resume.size() && ckpt.load(resume);
+	if (resuming) {
+		play_args += " load=" + resume + ".weights";
+	}
+
 	statistic stat(total, block, limit);
 
 	if (load.size()) {
@@ -57,25 +107,132 @@ int main(int argc, const char* argv[]) {
 	}
 
 	player play(play_args);
-	rndenv evil(evil_args);
-
-	while (!stat.is_finished()) {
-		play.open_episode("~:" + evil.name());
-		evil.open_episode(play.name() + ":~");
-
-		stat.open_episode(play.name() + ":" + evil.name());
-		episode& game = stat.back();
-		while (true) {
-			agent& who = game.take_turns(play, evil);
-			action move = who.take_action(game.state());
-			if (game.apply_action(move) != true) break;
-			if (who.check_for_win(game.state())) break;
+	if (serve.size()) { // own the tables for the workers until interrupted, then save them
+		std::signal(SIGINT, [](int) { interrupted = 1; });
+		std::signal(SIGTERM, [](int) { interrupted = 1; });
+		parameter_server server(play.tables(), play.tables_E(), play.tables_A(), map_size);
+		server.serve(serve, []() { return interrupted != 0; });
+		return 0;
+	}
+	if (play.remote() && (pipeline.size() || shard || deterministic || resume.size())) {
+		return -1; // these modes share or save the tables in process, which are owned by the server
+	}
+	if ((resume.size() || schedule.size()) && (thread || pipeline.size() || replay.size())) {
+		return -1; // the stages and checkpoints are run only by the serial loop below
+	}
+	if (resume.size() && (!play.resumable() || start_args.size())) {
+		return -1; // the state of the replay buffer, the batched updates, or the start pool would be lost
+	}
+	evaluator eval(play, eval_args);
+	trainer train(play, evil_args, stat, [&eval]() { eval.observe(); });
+	start_pool pool(start_args);
+	if (start_args.size()) {
+		train.restart(pool);
+	}
+
+	if (replay.size()) {
+		train.replay(replay, std::max(thread, size_t(1)));
+	}
+
+	if (pipeline.size()) {
+		train.pipeline(pipeline);
+	} else if (thread && deterministic) {
+		train.deterministic(thread, epoch);
+	} else if (thread && shard) {
+		train.sharded(thread, shard);
+	} else if (thread) {
+		train.hogwild(thread);
+	}
+
+	if (resuming) {
+		stat.resume(ckpt.episodes);
+		std::stringstream state(ckpt.player);
+		play.load_state(state);
+	}
+	if (resume.size()) {
+		std::signal(SIGINT, [](int) { interrupted = 1; });
+		std::signal(SIGTERM, [](int) { interrupted = 1; });
+	}
+
+	// save the checkpoint with the states of the agents, after the weights it refers to
+	auto save_checkpoint = [&](checkpoint& next, random_agent& evil) {
+		std::stringstream state;
+		play.save_state(state);
+		next.player = state.str();
+		state.str("");
+		evil.save_state(state);
+		next.environment = state.str();
+		play.save_checkpoint(resume + ".weights.tmp");
+		std::rename((resume + ".weights.tmp").c_str(), (resume + ".weights").c_str());
+		next.save(resume);
+	};
+
+	bool midway = resuming && (ckpt.played || ckpt.game.size()); // resuming within a stage
+	for (; ckpt.position < plan.size() && !stat.is_finished(); ckpt.position++, ckpt.played = 0) {
+		const checkpoint::stage& run = plan[ckpt.position];
+		std::unique_ptr<random_agent> environment = make_environment(evil_args + (run.seed.size() ? " seed=" + run.seed : ""), play);
+		random_agent& evil = *environment;
+		if (midway) {
+			std::stringstream state(ckpt.environment);
+			evil.load_state(state);
+		} else if (run.alpha.size()) {
+			play.notify("alpha=" + run.alpha);
 		}
-		agent& win = game.last_turns(play, evil);
-		stat.close_episode(win.name());
+		midway = false;
 
-		play.close_episode(win.name());
-		evil.close_episode(win.name());
+		bool paused = false;
+		while (ckpt.played < run.games && !stat.is_finished()) {
+			play.open_episode("~:" + evil.name());
+			evil.open_episode(play.name() + ":~");
+
+			stat.open_episode(play.name() + ":" + evil.name());
+			episode& game = stat.back();
+			if (ckpt.game.size()) {
+				std::stringstream(ckpt.game) >> game;
+				ckpt.game.clear();
+			}
+			while (true) {
+				agent& who = game.take_turns(play, evil);
+				action move = who.take_action(game.state());
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+				if (interrupted) { paused = true; break; }
+			}
+			if (paused) break;
+			agent& win = game.last_turns(play, evil);
+			stat.close_episode(win.name());
+			pool.observe(game);
+
+			play.close_episode(win.name());
+			evil.close_episode(win.name());
+			eval.observe();
+			ckpt.played++;
+			if (resume.size() && interval && ckpt.played % interval == 0 && ckpt.played < run.games) { // between games
+				checkpoint next = ckpt;
+				next.episodes = stat.episodes();
+				save_checkpoint(next, evil);
+			}
+		}
+
+		if (resume.size()) { // save after every stage, or at the move where the run is interrupted
+			checkpoint next = ckpt;
+			if (paused) {
+				std::stringstream text;
+				text << stat.back();
+				next.game = text.str();
+				next.episodes = stat.episodes() - 1;
+			} else {
+				next.position++;
+				next.played = 0;
+				next.episodes = stat.episodes();
+			}
+			save_checkpoint(next, evil);
+		}
+		if (paused) return 0;
+	}
+	if (resume.size()) { // the run is complete, so that a later run with --resume starts over
+		std::remove(resume.c_str());
+		std::remove((resume + ".weights").c_str());
 	}
 
 	if (summary) {
@@ -23,24 +23,13 @@ public:
 	class place; // create a placing action with position and tile
 
 public:
-	virtual board::reward apply(board& b) const {
-		auto proto = entries().find(type());
-		if (proto != entries().end()) return proto->second->reinterpret(this).apply(b);
-		return -1;
-	}
-	virtual std::ostream& operator >>(std::ostream& out) const {
-		auto proto = entries().find(type());
-		if (proto != entries().end()) return proto->second->reinterpret(this) >> out;
-		return out << "??";
-	}
-	virtual std::istream& operator <<(std::istream& in) {
-		auto state = in.rdstate();
-		for (auto proto = entries().begin(); proto != entries().end(); proto++) {
-			if (proto->second->reinterpret(this) << in) return in;
-			in.clear(state);
-		}
-		return in.ignore(2);
-	}
+	/**
+	 * the built-in types (slide and place) are dispatched by an inline switch on the type,
+	 * while the other types registered as prototypes are dispatched through the registry
+	 */
+	virtual board::reward apply(board& b) const;
+	virtual std::ostream& operator >>(std::ostream& out) const;
+	virtual std::istream& operator <<(std::istream& in);
 
 public:
 	operator unsigned() const { return code; }
@@ -124,3 +113,45 @@ protected:
 	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) place(*a); }
 	static __attribute__((constructor)) void init() { entries()[type_flag('p')] = new place; }
 };
+
+inline board::reward action::apply(board& b) const {
+	switch (type()) {
+	case slide::type: return slide(*this).slide::apply(b);
+	case place::type: return place(*this).place::apply(b);
+	}
+	auto proto = entries().find(type());
+	if (proto != entries().end()) return proto->second->reinterpret(this).apply(b);
+	return -1;
+}
+inline std::ostream& action::operator >>(std::ostream& out) const {
+	switch (type()) {
+	case slide::type: return slide(*this).slide::operator >>(out);
+	case place::type: return place(*this).place::operator >>(out);
+	}
+	auto proto = entries().find(type());
+	if (proto != entries().end()) return proto->second->reinterpret(this) >> out;
+	return out << "??";
+}
+inline std::istream& action::operator <<(std::istream& in) {
+	auto state = in.rdstate();
+	if (in.peek() == '#') {
+		slide move;
+		if (move.slide::operator <<(in)) {
+			code = move;
+			return in;
+		}
+	} else {
+		place move;
+		if (move.place::operator <<(in)) {
+			code = move;
+			return in;
+		}
+	}
+	in.clear(state);
+	for (auto proto = entries().begin(); proto != entries().end(); proto++) {
+		if (proto->first == slide::type || proto->first == place::type) continue;
+		if (proto->second->reinterpret(this) << in) return in;
+		in.clear(state);
+	}
+	return in.ignore(2);
+}
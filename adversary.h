@@ -0,0 +1,195 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * adversary.h: Environment placing the worst tiles for the player
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+/**
+ * a fixed set of threads which run the indices of a task together with the calling thread
+ */
+class search_pool {
+public:
+	search_pool(size_t threads = 0) : task(nullptr), count(0), next(0), active(0), generation(0), stop(false) {
+		for (size_t id = 1; id < threads; id++) workers.emplace_back(&search_pool::work, this);
+	}
+	~search_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers) worker.join();
+	}
+
+public:
+	/**
+	 * run task(i) for every i in [0, n), and return once all of them are done
+	 */
+	void run(size_t n, const std::function<void(size_t)>& job) {
+		if (workers.empty()) {
+			for (size_t i = 0; i < n; i++) job(i);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &job;
+			count = n;
+			next = 0;
+			generation++;
+		}
+		wake.notify_all();
+		for (size_t i; (i = next++) < n; ) job(i);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return active == 0 && next >= count; }); // no worker is left in this task
+		task = nullptr;
+	}
+
+protected:
+	void work() {
+		size_t seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [this, seen]() { return stop || (task && generation != seen); });
+			if (stop) return;
+			seen = generation;
+			const std::function<void(size_t)>& job = *task;
+			size_t n = count;
+			active++;
+			lock.unlock();
+			for (size_t i; (i = next++) < n; ) job(i);
+			lock.lock();
+			active--;
+			done.notify_all();
+		}
+	}
+
+protected:
+	std::vector<std::thread> workers;
+	const std::function<void(size_t)>* task;
+	size_t count;
+	std::atomic<size_t> next;
+	size_t active;
+	size_t generation;
+	bool stop;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+};
+
+/**
+ * adversarial environment, configured by "name=adversary depth=D thread=T"
+ * place the tile (a 2 or a 4 on any empty cell) which minimizes the value of the best reply of
+ * the player, judged by the n-tuple network of the player (player::board_value), where the
+ * value of a reply is its reward plus the value of its afterstate at depth 1, or the value
+ * of the worst placement on its afterstate at a depth of D - 1 otherwise
+ *
+ * the placements of a move are searched by T threads, and the first of the worst placements
+ * in the order of cells and tiles is taken, so that the choice does not depend on T
+ * every adversary has its own T threads, so W training threads (--thread=W) run W * T threads
+ * in total; a player reading its values from a parameter server is judged by a single thread,
+ * since its cache of values is not shared safely between threads
+ */
+class adversary : public random_agent {
+public:
+	adversary(player& judge, const std::string& args = "") : random_agent("name=adversary role=environment " + args),
+		judge(judge), depth(1) {
+		if (meta.find("depth") != meta.end())
+			depth = std::max(int(meta["depth"]), 1);
+		size_t threads = meta.find("thread") != meta.end() ? size_t(meta["thread"]) : 0;
+		if (threads > 1 && judge.remote()) std::exit(-1);
+		pool.reset(new search_pool(threads));
+	}
+
+	virtual action take_action(const board& after) {
+		placements.clear();
+		for (int pos = 0; pos < 16; pos++) {
+			if (after(pos) != 0) continue;
+			placements.push_back(action::place(pos, 1));
+			placements.push_back(action::place(pos, 2));
+		}
+		if (placements.empty()) return action();
+		values.resize(placements.size());
+		std::function<void(size_t)> job = [this, &after](size_t i) {
+			board b = after;
+			placements[i].apply(b);
+			values[i] = reply(b, depth);
+		};
+		pool->run(placements.size(), job);
+		size_t worst = 0;
+		for (size_t i = 1; i < values.size(); i++) {
+			if (values[i] < values[worst]) worst = i;
+		}
+		return placements[worst];
+	}
+
+protected:
+	/**
+	 * the value of the best reply of the player to a board, or 0 if the player cannot move
+	 */
+	float reply(const board& before, int depth) const {
+		float best = -std::numeric_limits<float>::max();
+		bool moved = false;
+		for (int op = 0; op < 4; op++) {
+			board after = before;
+			int reward = after.slide(op);
+			if (reward == -1) continue;
+			float value = reward + (depth > 1 ? place(after, depth - 1) : judge.board_value(after));
+			best = std::max(best, value);
+			moved = true;
+		}
+		return moved ? best : 0;
+	}
+	/**
+	 * the value of the worst placement on an afterstate
+	 */
+	float place(const board& after, int depth) const {
+		float worst = std::numeric_limits<float>::max();
+		for (int pos = 0; pos < 16; pos++) {
+			if (after(pos) != 0) continue;
+			for (board::cell tile : { 1u, 2u }) {
+				board b = after;
+				b(pos) = tile;
+				worst = std::min(worst, reply(b, depth));
+			}
+		}
+		return worst;
+	}
+
+protected:
+	player& judge;
+	int depth;
+	std::unique_ptr<search_pool> pool;
+	std::vector<action> placements;
+	std::vector<float> values;
+};
+
+/**
+ * create the environment selected by the name in its arguments: "name=adversary" for the
+ * adversary judged by the given player, or the random environment (rndenv) otherwise
+ */
+inline std::unique_ptr<random_agent> make_environment(const std::string& args, player& judge) {
+	std::string name;
+	std::stringstream ss(args);
+	for (std::string pair; ss >> pair; )
+		if (pair.find("name=") == 0) name = pair.substr(pair.find('=') + 1);
+	if (name == "adversary") return std::unique_ptr<random_agent>(new adversary(judge, args));
+	return std::unique_ptr<random_agent>(new rndenv(args));
+}
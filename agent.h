@@ -14,10 +14,22 @@
 #include <map>
 #include <type_traits>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <atomic>
 #include "board.h"
 #include "action.h"
 #include "weight.h"
+#include "precision.h"
+#include "update.h"
+#include "replay.h"
+#include "history.h"
+#include "shm.h"
+#include "server.h"
+#include "rng.h"
 #include <fstream>
+#include <iomanip>
+#include <limits>
 
 const int MAX_INDEX = 23;// the max tile index could occur.
 const int tuple_number = 32;
@@ -64,17 +76,91 @@ protected:
 
 /**
  * base agent for agents with randomness
+ *
+ * the engine is selected by "rng=legacy|xoshiro256|pcg64|philox", where legacy (the default)
+ * is std::default_random_engine as before, so that the old seeded runs are reproduced
  */
 class random_agent : public agent {
 public:
-	random_agent(const std::string& args = "") : agent(args) {
+	enum class generator { legacy, xoshiro256, pcg64, philox };
+
+	random_agent(const std::string& args = "") : agent(args), rng(generator::legacy) {
+		if (meta.find("rng") != meta.end()) {
+			std::string name = meta["rng"];
+			if (name == "xoshiro256") rng = generator::xoshiro256;
+			else if (name == "pcg64") rng = generator::pcg64;
+			else if (name == "philox") rng = generator::philox;
+			else if (name != "legacy") std::exit(-1);
+		}
+		if (rng != generator::legacy) {
+			reseed(meta.find("stream") != meta.end() ? std::stoull(meta["stream"]) : 0);
+			return;
+		}
 		if (meta.find("seed") != meta.end())
 			engine.seed(int(meta["seed"]));
+		if (meta.find("stream") != meta.end()) { // derive an independent stream for parallel workers
+			unsigned seed = meta.find("seed") != meta.end() ? unsigned(meta["seed"]) : 0;
+			std::seed_seq seq({ seed, unsigned(meta["stream"]) });
+			engine.seed(seq);
+		}
 	}
 	virtual ~random_agent() {}
 
+public:
+	/**
+	 * the state of the randomness, e.g., for a checkpoint to resume from
+	 */
+	virtual void save_state(std::ostream& out) const {
+		switch (rng) {
+		case generator::xoshiro256: out << xoshiro; break;
+		case generator::pcg64: out << pcg; break;
+		case generator::philox: out << counter_based; break;
+		default: out << engine; break;
+		}
+	}
+	virtual void load_state(std::istream& in) {
+		switch (rng) {
+		case generator::xoshiro256: in >> xoshiro; break;
+		case generator::pcg64: in >> pcg; break;
+		case generator::philox: in >> counter_based; break;
+		default: in >> engine; break;
+		}
+	}
+
+	/**
+	 * switch to the random stream of a counter, e.g., the index of a game, derived from the seed,
+	 * so that the randomness of a game does not depend on what was played before it
+	 */
+	virtual void switch_stream(uint64_t counter) {
+		if (rng != generator::legacy) {
+			reseed(counter);
+			return;
+		}
+		unsigned seed = meta.find("seed") != meta.end() ? unsigned(meta["seed"]) : 0;
+		std::seed_seq seq({ seed, unsigned(counter), unsigned(counter >> 32) });
+		engine.seed(seq);
+	}
+
 protected:
+	/**
+	 * seed the selected engine (other than legacy) with the seed and the given stream
+	 */
+	void reseed(uint64_t stream) {
+		uint64_t seed = meta.find("seed") != meta.end() ? std::stoull(meta["seed"]) : 0;
+		switch (rng) {
+		case generator::xoshiro256: xoshiro.seed(seed, stream); break;
+		case generator::pcg64: pcg.seed(seed, stream); break;
+		case generator::philox: counter_based.seed(seed, stream); break;
+		default: break;
+		}
+	}
+
+protected:
+	generator rng;
 	std::default_random_engine engine;
+	xoshiro256 xoshiro;
+	pcg64 pcg;
+	philox counter_based;
 };
 
 /**
@@ -82,22 +168,171 @@ protected:
  */
 class weight_agent : public agent {
 public:
-	weight_agent(const std::string& args = "") : agent(args), alpha(0) {
-		if (meta.find("init") != meta.end())
+	weight_agent(const std::string& args = "") : agent(args), alpha(0), stages(1) {
+		stage_of.fill(0);
+		if (meta.find("stage") != meta.end()) { // the tile thresholds where the next stage begins
+			std::stringstream list(meta["stage"]);
+			size_t last = 0;
+			for (std::string tile; std::getline(list, tile, ','); stages++) {
+				size_t first = std::stoul(tile);
+				if (first <= last) std::exit(-1); // the thresholds must be strictly increasing from 1
+				std::fill(stage_of.begin() + std::min(first, stage_of.size()), stage_of.end(), stages);
+				last = first;
+			}
+			if (uint64_t(4 * stages) * map_size > (uint64_t(1) << 32)) std::exit(-1); // the keys of updates are 32-bit
+		}
+		bool attached = false;
+		if (meta.find("shm") != meta.end())
+			attached = attach_weights(meta["shm"]);
+		if (meta.find("server") != meta.end())
+			attached = connect_weights(meta["server"]);
+		if (meta.find("init") != meta.end() && !attached)
 			init_weights(meta["init"]);
-		if (meta.find("load") != meta.end())
+		if (meta.find("load") != meta.end() && !attached)
 			load_weights(meta["load"]);
+		if (segment)
+			segment->publish();
 		if (meta.find("alpha") != meta.end())
 			alpha = float(meta["alpha"]);
 	}
+	/**
+	 * create a worker agent which shares the weight tables with the given agent
+	 * only the original agent saves the weights on destruction
+	 */
+	weight_agent(const weight_agent& w) : agent(w), alpha(w.alpha), stages(w.stages), stage_of(w.stage_of), server(w.server), cache(w.cache) {
+		meta.erase("save");
+		meta.erase("replay_save");
+		meta.erase("unlink");
+		share_weights(w);
+	}
 	virtual ~weight_agent() {
 		if (meta.find("save") != meta.end())
 			save_weights(meta["save"]);
+		if (meta.find("shm") != meta.end() && meta.find("unlink") != meta.end())
+			shared_segment::unlink(meta["shm"]);
+	}
+	virtual void notify(const std::string& msg) {
+		agent::notify(msg);
+		if (meta.find("alpha") != meta.end())
+			alpha = float(meta["alpha"]);
+	}
+
+public:
+	std::vector<weight>& tables() { return net; }
+	/**
+	 * whether the tables are owned by a parameter server, so that they cannot be shared in process
+	 */
+	bool remote() const { return bool(server); }
+	/**
+	 * the stage of a board, which selects the set of 4 tables by the largest tile in O(1)
+	 */
+	int stage(const board& b) const {
+		if (stages == 1) return 0;
+		board::cell top = 0;
+		for (int i = 0; i < 16; i++) top = std::max(top, b(i));
+		return stage_of[std::min(top, board::cell(stage_of.size() - 1))];
+	}
+	std::vector<tc_table>& tables_E() { return net_E; }
+	std::vector<tc_table>& tables_A() { return net_A; }
+
+	/**
+	 * take a private copy of the value tables, e.g., to serve as a snapshot for actors
+	 */
+	void detach_weights() {
+		for (weight& w : net) w = weight(w);
+	}
+	/**
+	 * overwrite the value tables with those of another agent in place
+	 * agents sharing these tables may observe a mix of old and new values meanwhile
+	 */
+	void refresh_weights(const weight_agent& w) {
+		for (size_t i = 0; i < net.size(); i++) net[i] = w.net[i];
 	}
 
 protected:
+	virtual void share_weights(const weight_agent& w) {
+		net.resize(w.net.size());
+		net_E.resize(w.net_E.size());
+		net_A.resize(w.net_A.size());
+		for (size_t i = 0; i < net.size(); i++) net[i].share(w.net[i]);
+		for (size_t i = 0; i < net_E.size(); i++) net_E[i].share(w.net_E[i]);
+		for (size_t i = 0; i < net_A.size(); i++) net_A[i].share(w.net_A[i]);
+	}
+	/**
+	 * attach the tables to a named shared memory segment, or create the segment if there is none,
+	 * in which case the tables are then initialized or loaded into the segment by the caller
+	 * only an agent with init or load creates the segment, and the others wait for it
+	 * return true if attached to a segment created by another process
+	 */
+	bool attach_weights(const std::string& name) {
+		segment = std::make_shared<shared_segment>(name);
+		bool attached = segment->attach();
+		bool creator = meta.find("init") != meta.end() || meta.find("load") != meta.end();
+		while (!attached && !creator) { // wait for a process which can fill the tables to create it
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			attached = segment->attach();
+		}
+		if (!attached) {
+			std::vector<uint64_t> sizes(12 * stages, map_size);
+			if (meta.find("load") != meta.end() && table_sizes(meta["load"]).size() == sizes.size())
+				sizes = table_sizes(meta["load"]);
+			std::vector<uint64_t> widths(sizes.size(), sizeof(tc_type));
+			std::fill(widths.begin(), widths.begin() + sizes.size() / 3, sizeof(weight::type));
+			if (!segment->create(sizes, widths) && !(attached = segment->attach())) std::exit(-1);
+		}
+		size_t n = segment->count() / 3;
+		std::vector<weight> views = segment->tables<weight::type>(0, n);
+		std::vector<tc_table> stats = segment->tables<tc_type>(n, 3 * n);
+		if (views.size() != n || stats.size() != 2 * n) std::exit(-1);
+		net.resize(n);
+		net_A.resize(n);
+		net_E.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			net[i].share(views[i]);
+			net_A[i].share(stats[i]);
+			net_E[i].share(stats[i + n]);
+		}
+		return attached;
+	}
+	/**
+	 * connect to a parameter server which owns the tables, whose values are read in batches into
+	 * a bounded cache of N entries ("cache=N"), each of which expires after R episodes
+	 * ("refresh=R"); the local tables are left empty, and the TC statistics are kept only by the server
+	 */
+	bool connect_weights(const std::string& path) {
+		if (meta.find("save") != meta.end()) std::exit(-1); // the tables are saved by the server, not by its workers
+		size_t capacity = meta.find("cache") != meta.end() ? size_t(meta["cache"]) : (1 << 20);
+		size_t refresh = meta.find("refresh") != meta.end() ? size_t(meta["refresh"]) : 4;
+		server = std::make_shared<parameter_client>(path);
+		uint64_t tables = 0, span = 0;
+		server->layout(tables, span);
+		if (tables != uint64_t(4 * stages) || span != uint64_t(map_size)) std::exit(-1); // the tables do not match the server
+		net.clear();
+		net.resize(tables);
+		net_E.clear();
+		net_E.resize(tables);
+		net_A.clear();
+		net_A.resize(tables);
+		cache = parameter_cache(std::max(capacity, size_t(1)), refresh);
+		return true;
+	}
+	static std::vector<uint64_t> table_sizes(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) std::exit(-1);
+		uint32_t count = 0;
+		in.read(reinterpret_cast<char*>(&count), sizeof(count));
+		std::vector<uint64_t> sizes(count);
+		for (uint64_t& size : sizes) {
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+			in.seekg(size * sizeof(weight::type), std::ios::cur);
+		}
+		return sizes;
+	}
 	virtual void init_weights(const std::string& info) {
-	    net.emplace_back(map_size);
+	    net.resize(4 * stages);
+	    net_A.resize(4 * stages);
+	    net_E.resize(4 * stages);
+	    if (net[0].size() != size_t(map_size)) net[0] = weight(map_size); // unless provided, e.g., by shared memory
 	    for(int i1=0;i1<MAX_INDEX;i1++){
 			for(int i2=0;i2<MAX_INDEX;i2++){
 				for(int i3=0;i3<MAX_INDEX;i3++){
@@ -116,23 +351,20 @@ protected:
 				}
 			}
 		}
-      	net_A.emplace_back(map_size);
-      	for(int i = 0; i < net_A[0].size(); i++)
+      	if (net_A[0].size() != size_t(map_size)) net_A[0] = tc_table(map_size);
+      	for(size_t i = 0; i < net_A[0].size(); i++)
       		net_A[0][i] = epsilon;
 
-      	for(int i = 1; i < 4; i++)
+      	for(size_t i = 1; i < net_A.size(); i++)
       	{
-      		net_A.emplace_back(1);
 	      	net_A[i] = net_A[0];
 	  	}
-		for(int i = 1; i < 4; i++)
+		for(size_t i = 1; i < net.size(); i++)
       	{
-          	net.emplace_back(1); // create an empty weight table with size map_size
-         	net[i] = net[0];
+         	net[i] = net[0]; // copied into the table in place if it has size map_size
 	 	}
-		for(int i = 0; i < 4; i++)
+		for(size_t i = 0; i < net_E.size(); i++)
 		{
-			net_E.emplace_back(1);
 			net_E[i] = net_A[0];
 		}
 	}
@@ -141,13 +373,32 @@ protected:
 		if (!in.is_open()) std::exit(-1);
 		uint32_t size;
 		in.read(reinterpret_cast<char*>(&size), sizeof(size));
-		net.resize(size / 3);
-        net_A.resize(size / 3);
-        net_E.resize(size / 3);
-		for (weight& w : net) in >> w;
-		for (weight& w : net_A) in >> w;
-		for (weight& w : net_E) in >> w;
+		size_t n = size / 3;
+		net.resize(std::max(n, net.size())); // keep the tables provided, e.g., by shared memory
+        net_A.resize(std::max(n, net_A.size()));
+        net_E.resize(std::max(n, net_E.size()));
+		for (size_t i = 0; i < n; i++) in >> net[i];
+		for (size_t i = 0; i < n; i++) in >> net_A[i];
+		for (size_t i = 0; i < n; i++) in >> net_E[i];
 		in.close();
+		expand_stages(n);
+	}
+	/**
+	 * copy the tables of a single-stage network to all stages, e.g., to start a multi-stage
+	 * network from a trained single-stage one
+	 */
+	void expand_stages(size_t n) {
+		size_t tables = 4 * stages;
+		if (n == tables) return;
+		if (n != 4) std::exit(-1); // the stages of the file do not match the thresholds
+		net.resize(tables);
+		net_A.resize(tables);
+		net_E.resize(tables);
+		for (size_t i = n; i < tables; i++) {
+			net[i] = net[i % 4];
+			net_A[i] = net_A[i % 4];
+			net_E[i] = net_E[i % 4];
+		}
 	}
 	virtual void save_weights(const std::string& path) {
 		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
@@ -155,16 +406,21 @@ protected:
 		uint32_t size = net.size() + net_A.size() + net_E.size();
 		out.write(reinterpret_cast<char*>(&size), sizeof(size));
 		for (weight& w : net) out << w;
-		for (weight& w : net_A) out << w;
-		for (weight& w : net_E) out << w;
+		for (tc_table& w : net_A) out << w;
+		for (tc_table& w : net_E) out << w;
 		out.close();
 	}
 
 protected:
 	std::vector<weight> net;
-	std::vector<weight> net_E;
-	std::vector<weight> net_A;
+	std::vector<tc_table> net_E;
+	std::vector<tc_table> net_A;
     float alpha;
+	int stages; // the number of stages, each of which has its own set of 4 tables
+	std::array<uint8_t, 32> stage_of; // the stage of each largest tile
+	std::shared_ptr<shared_segment> segment; // the shared memory segment holding the tables, if any
+	std::shared_ptr<parameter_client> server; // the connection to the parameter server owning the tables, if any
+	parameter_cache cache; // the values read from the server, private to each copy of the agent
 };
 
 /**
@@ -172,17 +428,60 @@ protected:
  * add a new random tile to an empty cell
  * 2-tile: 90%
  * 4-tile: 10%
+ *
+ * the cell is chosen by shuffling the positions (the default), or by "place=fast", which draws
+ * k = uniform_int_distribution(0, n - 1) over the n empty cells and takes the k-th empty cell
+ * in ascending index order, i.e., the k-th set bit of the empty mask; the two modes consume
+ * the random engine differently, so a seeded run is reproducible only under the same mode
  */
 class rndenv : public random_agent {
 public:
 	rndenv(const std::string& args = "") : random_agent("name=random role=environment " + args),
-		space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), popup(0, 9) {}
+		space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), popup(0, 9), fast(false) {
+		if (meta.find("place") != meta.end())
+			fast = (std::string(meta["place"]) == "fast");
+	}
 
 	virtual action take_action(const board& after) {
-		std::shuffle(space.begin(), space.end(), engine);
+		switch (rng) {
+		case generator::xoshiro256: return place_tile(after, xoshiro);
+		case generator::pcg64: return place_tile(after, pcg);
+		case generator::philox: return place_tile(after, counter_based);
+		default: return place_tile(after, engine);
+		}
+	}
+
+	/**
+	 * the positions are shuffled in place, so their order is a part of the state as well
+	 */
+	virtual void save_state(std::ostream& out) const {
+		random_agent::save_state(out);
+		for (int pos : space) out << ' ' << pos;
+	}
+	virtual void load_state(std::istream& in) {
+		random_agent::load_state(in);
+		for (int& pos : space) in >> pos;
+	}
+	virtual void switch_stream(uint64_t counter) {
+		random_agent::switch_stream(counter);
+		for (int i = 0; i < 16; i++) space[i] = i;
+	}
+
+protected:
+	template<typename random>
+	action place_tile(const board& after, random& source) {
+		if (fast) {
+			uint32_t mask = after.empty_mask();
+			if (!mask) return action();
+			int k = std::uniform_int_distribution<int>(0, __builtin_popcount(mask) - 1)(source);
+			for (; k; k--) mask &= mask - 1; // clear the lowest set bits before the k-th
+			board::cell tile = popup(source) ? 1 : 2;
+			return action::place(__builtin_ctz(mask), tile);
+		}
+		std::shuffle(space.begin(), space.end(), source);
 		for (int pos : space) {
 			if (after(pos) != 0) continue;
-			board::cell tile = popup(engine) ? 1 : 2;
+			board::cell tile = popup(source) ? 1 : 2;
 			return action::place(pos, tile);
 		}
 		return action();
@@ -191,6 +490,73 @@ public:
 private:
 	std::array<int, 16> space;
 	std::uniform_int_distribution<int> popup;
+	bool fast;
+};
+
+/**
+ * random environment of K games stepped together, e.g., by a thread driving many games
+ * add a new random tile to an empty cell of each board, as rndenv with "place=fast"
+ * 2-tile: 90%
+ * 4-tile: 10%
+ *
+ * every game has its own lane of xoshiro256**, and a single 64-bit draw of a lane places
+ * a tile: the cell is the k-th empty cell with k = (high 32 bits * n) >> 32 over the n empty
+ * cells, and the tile is 4 if (low 32 bits * 10) >> 32 is 0; both are off from uniform by
+ * less than n / 2^32, in exchange for the draws of all lanes having no branch
+ */
+class rndenv_batch : public random_agent {
+public:
+	rndenv_batch(size_t lanes, const std::string& args = "") : random_agent("name=random role=environment " + args) {
+		uint64_t first = meta.find("stream") != meta.end() ? std::stoull(meta["stream"]) * lanes : 0;
+		uint64_t seed = meta.find("seed") != meta.end() ? std::stoull(meta["seed"]) : 0;
+		generators = xoshiro256_lanes(lanes, seed, first);
+		masks.resize(lanes);
+	}
+
+	size_t lanes() const { return generators.size(); }
+
+	/**
+	 * place a tile on each of the first count boards, where board i uses lane i
+	 * a board without any empty cell gets an invalid action
+	 */
+	void take_actions(const board* after, action* moves, size_t count) {
+		count = std::min(count, lanes());
+		for (size_t i = 0; i < count; i++) masks[i] = after[i].empty_mask();
+		const std::vector<uint64_t>& draw = generators();
+		for (size_t i = 0; i < count; i++) {
+			uint32_t mask = masks[i];
+			if (!mask) {
+				moves[i] = action();
+				continue;
+			}
+			uint64_t k = ((draw[i] >> 32) * __builtin_popcount(mask)) >> 32;
+			for (; k; k--) mask &= mask - 1; // clear the lowest set bits before the k-th
+			board::cell tile = ((draw[i] & 0xffffffffull) * 10) >> 32 ? 1 : 2;
+			moves[i] = action::place(__builtin_ctz(mask), tile);
+		}
+	}
+	/**
+	 * place a tile on a single board with the first lane, as rndenv::take_action
+	 */
+	virtual action take_action(const board& after) {
+		action move;
+		take_actions(&after, &move, 1);
+		return move;
+	}
+
+	virtual void save_state(std::ostream& out) const { out << generators; }
+	virtual void load_state(std::istream& in) { in >> generators; }
+	/**
+	 * switch lane i to the stream (counter * K + i), e.g., for the counter-th batch of games
+	 */
+	virtual void switch_stream(uint64_t counter) {
+		uint64_t seed = meta.find("seed") != meta.end() ? std::stoull(meta["seed"]) : 0;
+		generators.seed(seed, counter * lanes());
+	}
+
+private:
+	xoshiro256_lanes generators;
+	std::vector<uint32_t> masks;
 };
 
 /**
@@ -199,8 +565,55 @@ private:
  */
 class player : public weight_agent {
 public:
+	typedef history_arena<tuple_number>::state state;
+
 	player(const std::string& args = "") : weight_agent("name=dummy role=player " + args),
-		opcode({ 0, 1, 2, 3 }), space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }) {}
+		opcode({ 0, 1, 2, 3 }), space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), batch(0), batched(0), train_depth(2), eval_depth(2),
+		online(0), horizon(0), window_head(0), window_size(0), replay(std::make_shared<replay_buffer>()), replay_batch(0), frozen(false), skip(0) {
+		if (meta.find("batch") != meta.end())
+			batch = int(meta["batch"]);
+		if (meta.find("train_depth") != meta.end())
+			train_depth = std::max(int(meta["train_depth"]), 1);
+		if (meta.find("eval_depth") != meta.end())
+			eval_depth = std::max(int(meta["eval_depth"]), 1);
+		if (meta.find("online") != meta.end())
+			online = int(meta["online"]);
+		window.resize(online);
+		if (meta.find("horizon") != meta.end()) {
+			if (int(meta["horizon"]) < 0) std::exit(-1); // no horizon for a negative number of steps
+			horizon = int(meta["horizon"]);
+		}
+		if (meta.find("trace_eps") != meta.end()) { // the horizon where lambda^H drops below the threshold
+			float eps = float(meta["trace_eps"]);
+			if (!(eps > 0 && eps < 1)) std::exit(-1); // no horizon for a threshold outside (0, 1)
+			horizon = std::max(int(std::ceil(std::log(eps) / std::log(lembda))), 1);
+		}
+		if (meta.find("replay") != meta.end()) {
+			std::string mode = "uniform";
+			if (meta.find("replay_mode") != meta.end())
+				mode = std::string(meta["replay_mode"]);
+			if (mode != "uniform" && mode != "priority" && mode != "recent") std::exit(-1);
+			unsigned seed = meta.find("seed") != meta.end() ? unsigned(meta["seed"]) : std::mt19937::default_seed;
+			replay = std::make_shared<replay_buffer>(int(meta["replay"]), mode, seed);
+			online = horizon = 0;
+		}
+		if (meta.find("replay_batch") != meta.end())
+			replay_batch = int(meta["replay_batch"]);
+		if (meta.find("replay_load") != meta.end())
+			replay->load(meta["replay_load"]);
+		if (meta.find("skip") != meta.end())
+			skip = float(meta["skip"]);
+		if (server) // the updates of every episode are sent to the server
+			batch = std::max(batch, size_t(1));
+	}
+	virtual ~player() {
+		flush_updates();
+		if (skip && !steps.copy && steps.total_stepped())
+			std::cout << "skipped " << steps.total_skipped() << " of " << steps.total_stepped() << " update steps ("
+				<< (steps.total_skipped() * 100.0 / steps.total_stepped()) << "%)" << std::endl;
+		if (meta.find("replay_save") != meta.end())
+			replay->save(meta["replay_save"]);
+	}
 
 	unsigned long get_feature(const board& boardstate, const std::vector<int>& pattern)
     {
@@ -216,27 +629,116 @@ public:
     }
     float board_value(const board& boardstate)
     {
+        if(server)
+        {
+            uint32_t feature[tuple_number];
+            int stage = get_features(boardstate, feature);
+            return feature_value(feature, stage);
+        }
         float value = 0;
+        weight* tables = &net[stage(boardstate) * 4];
+        for(int i = 0; i < tuple_number; i++)
+        {
+       		value += tables[i/8][get_feature(boardstate, pattern[i])];
+        }
+        return value;
+    }
+    /**
+     * extract the feature indices of a board, return the stage of the tables they index
+     */
+    int get_features(const board& boardstate, uint32_t* feature)
+    {
         for(int i = 0; i < tuple_number; i++)
+            feature[i] = get_feature(boardstate, pattern[i]);
+        return stage(boardstate);
+    }
+    float feature_value(const uint32_t* feature, int stage)
+    {
+        float value = 0;
+        if(server) // take the values from the cache, and read the missing ones from the server at once
         {
-       		value += net[i/8][get_feature(boardstate, pattern[i])];
+            missing.clear();
+            request(feature, stage);
+            prefetch();
+            uint32_t base = stage * 4 * map_size;
+            for(int i = 0; i < tuple_number; i++)
+            {
+                uint32_t key = base + (i/8) * map_size + feature[i];
+                float v;
+                if(!cache.find(key, v)) // evicted by another key of the same board
+                    v = fetched[std::lower_bound(missing.begin(), missing.end(), key) - missing.begin()];
+                value += v;
+            }
+            return value;
         }
+        weight* tables = &net[stage * 4];
+        for(int i = 0; i < tuple_number; i++)
+            value += tables[i/8][feature[i]];
         return value;
     }
+    /**
+     * note the keys of the features missing from the cache of a server-backed player
+     */
+    void request(const uint32_t* feature, int stage)
+    {
+        uint32_t base = stage * 4 * map_size;
+        float v;
+        for(int i = 0; i < tuple_number; i++)
+        {
+            uint32_t key = base + (i/8) * map_size + feature[i];
+            if(!cache.find(key, v)) missing.push_back(key);
+        }
+    }
+    void request(const board& boardstate)
+    {
+        uint32_t feature[tuple_number];
+        int stage = get_features(boardstate, feature);
+        request(feature, stage);
+    }
+    /**
+     * read the values of the requested keys from the server in a single message into the cache
+     * the keys and their values are kept sorted in missing and fetched until missing is cleared
+     */
+    void prefetch()
+    {
+        std::sort(missing.begin(), missing.end());
+        missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+        if(missing.size()) server->read(missing, fetched);
+        else fetched.clear();
+        for(size_t k = 0; k < missing.size(); k++)
+            cache.store(missing[k], fetched[k]);
+    }
 
     /**********************2-ply modify*********************/
+	/**
+	 * the search depth in plies, where 1 is greedy on the afterstate values and 2 is the 2-ply expectimax
+	 * learning games (alpha > 0) use train_depth, and evaluation games (alpha = 0) use eval_depth
+	 */
+	int search_depth() const { return alpha ? train_depth : eval_depth; }
+
 	virtual action take_action(const board& before) {//2-ply
+		int depth = search_depth() - 1;
 		int best_op = 0;
 		int best_reward = 0;
 		float best_expectation = MIN_FLOAT;
 		board best_afterstate;
+		if(server) // read the values of all leaves of the search from the server at once
+		{
+			missing.clear();
+			for(int op : opcode)
+			{
+				board after = before;
+				if(after.slide(op) != -1) request_leaves(after, depth);
+			}
+			prefetch();
+		}
 		for(int op : opcode)
         {
             board after = before;
             int reward = after.slide(op);
             if(reward == -1) continue;
 
-            float expectation = put_tile(after, 1);
+            float expectation = put_tile(after, depth);
             if(expectation + reward > best_expectation + best_reward)
             {
                 best_op = op;
@@ -246,7 +748,7 @@ public:
             }
         }
         if(best_expectation != MIN_FLOAT)
-            history.push_back({best_afterstate, best_reward});
+            record(best_afterstate, best_reward);
         return action::slide(best_op);
 	}
 	float put_tile(const board& before, const int& depth)
@@ -274,6 +776,31 @@ public:
 		expectation /= empty_grid;
 		return expectation;
 	}
+	/**
+	 * request the afterstates evaluated by put_tile at the given depth, as put_tile searches them
+	 */
+	void request_leaves(const board& before, int depth)
+	{
+		if(depth == 0)
+		{
+			request(before);
+			return;
+		}
+		for(int pos : space)
+		{
+			if(before(pos) != 0) continue;
+			for(int tile : {1, 2})
+			{
+				board after = before;
+				after(pos) = tile;
+				for(int op : opcode)
+				{
+					board next = after;
+					if(next.slide(op) != -1) request_leaves(next, depth - 1);
+				}
+			}
+		}
+	}
 	float move_simulation(const board& before, const int& depth) {
 		float expectation;
 		float best_expectation = MIN_FLOAT;
@@ -297,52 +824,428 @@ public:
 
 	virtual void close_episode(const std::string& flag = "")
 	{
-		float history_value = 0;
-    	train_weights(history[history.size()-1].afterstate, history_value);//T-1 turn
-    	for(int i = history.size() - 2; i >= 0; i--)
-    	{
-    		train_weights(history[i].afterstate, history[i+1].afterstate, history[i+1].reward, history_value);
-    	}
-    	history.clear();
+		if(server) // the cached values expire by the episodes, however the updates are batched
+			cache.tick();
+		if(frozen)
+		{
+			discard_episode();
+			return;
+		}
+		if(server) // read the values of the backward pass from the server at once
+		{
+			missing.clear();
+			for(size_t i = 0; i < history.size(); i++)
+				request(history[i].feature, history[i].stage);
+			for(size_t k = 0; k < window_size; k++)
+				request(window_at(k).afterstate);
+			prefetch();
+		}
+		if(replay->capacity())
+		{
+			close_replay();
+		}
+		else if(online)
+		{
+			close_window();
+		}
+		else if(horizon && history.size())
+		{
+			close_truncated();
+		}
+		else if(history.size())
+		{
+			float history_value = 0;
+	    	train_weights(history.back(), history_value);//T-1 turn
+	    	for(int i = history.size() - 2; i >= 0; i--)
+	    	{
+	    		train_weights(history[i], history[i+1], history[i+1].reward, history_value);
+	    	}
+	    	history.clear();
+		}
+    	if(!batch || ++batched % batch == 0) flush_updates();
     	return;
 	}
 
+	/**
+	 * record the afterstate chosen by a move and the reward of the move
+	 * in online mode, only the afterstates of the last W moves are kept in a window, and
+	 * the afterstate leaving the window is updated with its lambda-return truncated to W steps
+	 */
+	void record(const board& afterstate, int reward)
+	{
+		if(frozen) return;
+		if(!online)
+		{
+			state& s = history.push(afterstate, reward);
+			s.stage = get_features(afterstate, s.feature);
+			return;
+		}
+		float value = board_value(afterstate);
+		if(window_size)
+		{
+			trace& last = window_at(window_size - 1);
+			last.delta = reward + value - last.value;
+		}
+		if(window_size == online)
+		{
+			float history_value = 0, decay = 1;
+			for(size_t k = 0; k < window_size; k++, decay *= lembda)
+				history_value += alpha * decay * window_at(k).delta;
+			update_weights(window_at(0).afterstate, history_value, window_at(0).delta);
+			window_head = (window_head + 1) % online;
+			window_size--;
+		}
+		window_at(window_size++) = {afterstate, value, 0};
+	}
+	/**
+	 * feed the transitions of the game into the replay buffer, then learn from a batch of
+	 * transitions sampled from the buffer by one-step TD, which replaces the backward pass
+	 * the batch size defaults to the number of transitions fed by the game
+	 * the buffer is shared by all copies of the player, e.g., the workers, under its lock
+	 */
+	void close_replay()
+	{
+		replay_buffer& buffer = *replay;
+		std::unique_lock<std::mutex> lock(buffer.guard());
+		for(size_t i = 0; i < history.size(); i++)
+		{
+			experience e;
+			bool terminal = (i + 1 == history.size());
+			std::copy(history[i].tile, history[i].tile + 16, e.before);
+			if(terminal) std::fill(e.after, e.after + 16, 0);
+			else std::copy(history[i+1].tile, history[i+1].tile + 16, e.after);
+			e.reward = terminal ? 0 : history[i+1].reward;
+			e.terminal = terminal;
+			e.stage = history[i].stage;
+			std::copy(history[i].feature, history[i].feature + tuple_number, e.feature);
+			buffer.push(e);
+		}
+		size_t samples = replay_batch ? replay_batch : history.size();
+		history.clear();
+		for(size_t n = 0; n < samples && buffer.size(); n++)
+		{
+			size_t i = buffer.sample();
+			experience e = buffer.at(i); // copied, as other workers may overwrite it meanwhile
+			lock.unlock();
+			float target = e.terminal ? 0 : e.reward + board_value(experience::unpack(e.after));
+			float delta = target - feature_value(e.feature, e.stage);
+			update_features(e.feature, e.stage, alpha * delta, delta);
+			lock.lock();
+			buffer.prioritize(i, std::fabs(delta));
+		}
+	}
+	/**
+	 * the backward pass with the lambda-return truncated to a horizon of H steps
+	 * the values of all afterstates are gathered once before any update, so that each step
+	 * costs a single gather for its value and the truncated return is maintained in O(1)
+	 */
+	void close_truncated()
+	{
+		size_t last = history.size() - 1;
+		values.resize(history.size());
+		errors.resize(history.size());
+		for(size_t i = 0; i <= last; i++)
+			values[i] = feature_value(history[i].feature, history[i].stage);
+		for(size_t i = 0; i < last; i++)
+			errors[i] = history[i+1].reward + values[i+1] - values[i];
+		errors[last] = -values[last];//TD target is 0;
+		float decay = std::pow(lembda, float(horizon));
+		float history_value = 0;
+		for(size_t i = last + 1; i-- > 0; )
+		{
+			history_value = alpha * errors[i] + history_value * lembda;
+			if(i + horizon <= last)
+				history_value -= alpha * decay * errors[i + horizon];
+			float delta = (i == last) ? values[last] : errors[i];
+			update_features(history[i].feature, history[i].stage, history_value, delta);
+		}
+		history.clear();
+	}
+	/**
+	 * learn from the afterstates remaining in the window at the end of a game
+	 * the TD errors were computed during the game, so this is the backward pass over at most W steps
+	 */
+	void close_window()
+	{
+		if(window_size)
+		{
+			float history_value = 0;
+			train_weights(window_at(window_size - 1).afterstate, history_value);//T-1 turn
+			for(int i = window_size - 2; i >= 0; i--)
+			{
+				history_value = alpha * window_at(i).delta + history_value * lembda;
+				update_weights(window_at(i).afterstate, history_value, window_at(i).delta);
+			}
+		}
+		window_head = 0;
+		window_size = 0;
+	}
+
+	/**
+	 * learn from a recorded game given by the codes of its actions
+	 * the afterstates are rebuilt by replaying the actions, without any search
+	 */
+	void learn_episode(const std::vector<unsigned>& moves, const board& start = board())
+	{
+		board state = start;
+		for (unsigned code : moves)
+		{
+			action move(code);
+			board::reward reward = move.apply(state);
+			if (move.type() == action::slide::type && reward != -1)
+				record(state, reward);
+		}
+		close_episode();
+	}
+	/**
+	 * drop the afterstates of the current game without learning from them
+	 */
+	void discard_episode()
+	{
+		history.clear();
+		window_head = 0;
+		window_size = 0;
+	}
+	/**
+	 * stop learning, so that the player only plays, e.g., as an actor or an evaluator of a snapshot
+	 * the search depth still follows alpha, which can be changed by notify("alpha=0")
+	 */
+	void freeze()
+	{
+		frozen = true;
+		discard_episode();
+	}
+
 	void train_weights(const board& prev_board,const board& next_board,const float &reward, float &history_value)
 	{
 	    float delta = reward + board_value(next_board) - board_value(prev_board);
 	   	history_value = alpha * delta + history_value * lembda;
-	    for(int i = 0; i < tuple_number; i++)
-        {
-            long feature = get_feature(prev_board, pattern[i]);
-            float learning_rate = fabs(net_E[i/8][feature]) / net_A[i/8][feature];
-        	net[i/8][get_feature(prev_board, pattern[i])] += history_value * learning_rate / 8;
-        	net_E[i/8][feature] += delta / 8;
-        	net_A[i/8][feature] += fabs(delta) / 8;
-        }
+	   	update_weights(prev_board, history_value, delta);
         return;
 	}
 	void train_weights(const board& final_board, float& history_value)
 	{
         float delta = board_value(final_board);//TD target is 0;
         history_value = -alpha * delta;
-        for(int i = 0; i < tuple_number; i++)
+        update_weights(final_board, history_value, delta);
+        return;
+	}
+	/**
+	 * the same steps on the recorded afterstates, whose features were extracted when recorded
+	 */
+	void train_weights(const state& prev, const state& next, const float &reward, float &history_value)
+	{
+	    float delta = reward + feature_value(next.feature, next.stage) - feature_value(prev.feature, prev.stage);
+	   	history_value = alpha * delta + history_value * lembda;
+	   	update_features(prev.feature, prev.stage, history_value, delta);
+	}
+	void train_weights(const state& final, float& history_value)
+	{
+        float delta = feature_value(final.feature, final.stage);//TD target is 0;
+        history_value = -alpha * delta;
+        update_features(final.feature, final.stage, history_value, delta);
+	}
+	/**
+	 * apply the TC update to the features of a board,
+	 * or defer it to the update buffer if the updates are batched
+	 */
+	void update_weights(const board& boardstate, float history_value, float delta)
+	{
+		uint32_t feature[tuple_number];
+		int stage = get_features(boardstate, feature);
+		update_features(feature, stage, history_value, delta);
+	}
+	void update_features(const uint32_t* feature, int stage, float history_value, float delta)
+	{
+		weight* tables = &net[stage * 4];
+		tc_table* tables_E = &net_E[stage * 4];
+		tc_table* tables_A = &net_A[stage * 4];
+		uint32_t base = stage * 4 * map_size;
+		if(skip)
+		{
+			steps.stepped++;
+			if(std::fabs(history_value) < skip) // only defer the statistics, which are flushed with the batch
+			{
+				steps.skipped++;
+				for(int i = 0; i < tuple_number; i++)
+					updates.push(base + (i/8) * map_size + feature[i], 0, delta / 8);
+				return;
+			}
+		}
+	    for(int i = 0; i < tuple_number; i++)
         {
-            long feature = get_feature(final_board, pattern[i]);
-            float learning_rate = fabs(net_E[i/8][feature]) / net_A[i/8][feature];
-        	net[i/8][get_feature(final_board, pattern[i])] += history_value * learning_rate / 8;
-        	net_E[i/8][feature] += delta / 8;
-        	net_A[i/8][feature] += fabs(delta) / 8;
+            if(batch)
+            {
+                updates.push(base + (i/8) * map_size + feature[i], history_value / 8, delta / 8);
+                continue;
+            }
+            float learning_rate = fabs(tables_E[i/8][feature[i]]) / tables_A[i/8][feature[i]];
+        	tables[i/8][feature[i]] += history_value * learning_rate / 8;
+        	tc_accumulate(tables_E[i/8][feature[i]], tables_A[i/8][feature[i]], delta / 8, fabs(delta) / 8);
         }
-        return;
 	}
-	struct state{
+	/**
+	 * apply the deferred updates in address order, or pass them to the sink if redirected,
+	 * or send them to the parameter server if connected
+	 */
+	void flush_updates()
+	{
+		if(updates.empty()) return;
+		if(sink) sink(updates);
+		else if(server) server->push(updates, cache);
+		else updates.apply(net, net_E, net_A, map_size);
+	}
+	/**
+	 * defer the updates of every episode and pass them to another owner of the tables,
+	 * e.g., the shards, instead of applying them here; the sink should consume the buffer
+	 */
+	void redirect_updates(const std::function<void(update_buffer&)>& to)
+	{
+		sink = to;
+		batch = std::max(batch, size_t(1));
+	}
+	/**
+	 * defer all updates until flush_updates is called, e.g., to merge the updates of workers
+	 * in a fixed order
+	 */
+	void hold_updates()
+	{
+		batch = std::numeric_limits<size_t>::max();
+	}
+	/**
+	 * flush the deferred updates and save the weights now, e.g., as a part of a checkpoint
+	 */
+	void save_checkpoint(const std::string& path)
+	{
+		flush_updates();
+		save_weights(path);
+	}
+	/**
+	 * whether save_state and the weights hold the whole learning state, so that a run resumed
+	 * from a checkpoint continues as if uninterrupted; not with a replay buffer, whose contents
+	 * and engine are not saved, nor with batched updates, which a checkpoint flushes midway
+	 */
+	bool resumable() const
+	{
+		return !replay->capacity() && !batch;
+	}
+	/**
+	 * the learning state besides the weights: alpha, and the afterstates of the game in progress
+	 * recorded in the history (or in the window of online mode), so that a game can be resumed
+	 */
+	void save_state(std::ostream& out) const
+	{
+		out << std::setprecision(std::numeric_limits<float>::max_digits10);
+		out << alpha << ' ' << batched << ' ' << history.size();
+		for (size_t k = 0; k < history.size(); k++)
+		{
+			for (int i = 0; i < 16; i++) out << ' ' << unsigned(history[k].tile[i]);
+			out << ' ' << history[k].reward;
+		}
+		out << ' ' << window_size;
+		for (size_t k = 0; k < window_size; k++)
+		{
+			const trace& t = window[(window_head + k) % online];
+			for (int i = 0; i < 16; i++) out << ' ' << t.afterstate(i);
+			out << ' ' << t.value << ' ' << t.delta;
+		}
+	}
+	void load_state(std::istream& in)
+	{
+		std::string rate;
+		size_t size = 0;
+		in >> rate >> batched >> size;
+		notify("alpha=" + rate);
+		history.clear();
+		for (size_t k = 0; k < size; k++)
+		{
+			board afterstate;
+			int reward;
+			for (int i = 0; i < 16; i++) in >> afterstate(i);
+			in >> reward;
+			state& s = history.push(afterstate, reward);
+			s.stage = get_features(afterstate, s.feature);
+		}
+		in >> size;
+		window_head = 0;
+		window_size = std::min(size, online);
+		for (size_t k = 0; k < size; k++)
+		{
+			trace t;
+			for (int i = 0; i < 16; i++) in >> t.afterstate(i);
+			in >> t.value >> t.delta;
+			if (k < window_size) window[k] = t;
+		}
+	}
+
+	history_arena<tuple_number> history;
+private:
+	struct trace{
 		board afterstate;
-		int reward;
+		float value; // the value when the afterstate was recorded
+		float delta; // the TD error towards the next afterstate
 	};
-	std::vector<state> history;
-private:
+	trace& window_at(size_t i) { return window[(window_head + i) % online]; }
+
 	std::array<int, 4> opcode;
 	std::array<int, 16> space;
+	update_buffer updates;
+	std::function<void(update_buffer&)> sink;
+	size_t batch; // number of episodes whose updates are batched, or 0 to update immediately
+	size_t batched;
+	int train_depth;
+	int eval_depth;
+	size_t online; // the window size of online TD(lambda), or 0 to learn at the end of games
+	size_t horizon; // the truncation horizon of the lambda-return, or 0 to propagate through the whole game
+	std::vector<float> values;
+	std::vector<float> errors;
+	std::vector<trace> window;
+	size_t window_head;
+	size_t window_size;
+	std::shared_ptr<replay_buffer> replay; // the replay buffer, which replaces the backward pass if it has a capacity, shared by the copies
+	size_t replay_batch;
+	bool frozen;
+	float skip; // the threshold of |step| below which the weight writes are skipped, or 0 to write all
+	std::vector<uint32_t> missing; // the keys requested from the parameter server, if connected
+	std::vector<float> fetched; // the values of the keys read from the parameter server
+
+	/**
+	 * the counters of skipped updates, shared by a player and all of its copies (the workers)
+	 * a copy starts from zero and adds its counts into the shared totals when destroyed,
+	 * so that the original player reports the counts of the whole run once
+	 */
+	struct step_counter {
+		struct totals {
+			std::atomic<size_t> skipped;
+			std::atomic<size_t> stepped;
+			totals() : skipped(0), stepped(0) {}
+		};
+		step_counter() : skipped(0), stepped(0), shared(std::make_shared<totals>()), copy(false) {}
+		step_counter(const step_counter& c) : skipped(0), stepped(0), shared(c.shared), copy(true) {}
+		step_counter& operator =(const step_counter& c) {
+			release();
+			skipped = stepped = 0;
+			shared = c.shared;
+			copy = true;
+			return *this;
+		}
+		~step_counter() { release(); }
+
+		size_t total_skipped() const { return skipped + shared->skipped; }
+		size_t total_stepped() const { return stepped + shared->stepped; }
+		void release() {
+			if (!copy) return;
+			shared->skipped += skipped;
+			shared->stepped += stepped;
+			skipped = stepped = 0;
+		}
+
+		size_t skipped;
+		size_t stepped;
+		std::shared_ptr<totals> shared;
+		bool copy;
+	};
+	step_counter steps;
 };
 
 const std::vector<std::vector<int>> agent::pattern = {
@@ -71,6 +71,14 @@ public:
 	grid get_tile(){
 		return this->tile;
 	}
+	/**
+	 * the mask of the empty cells, where bit i is set if cell i (1-d form index) is empty
+	 */
+	uint32_t empty_mask() const {
+		uint32_t mask = 0;
+		for (unsigned i = 0; i < 16; i++) mask |= uint32_t(operator ()(i) == 0) << i;
+		return mask;
+	}
 	/**
 	 * place a tile (index value) to the specific position (1-d form index)
 	 * return 0 if the action is valid, or -1 if not
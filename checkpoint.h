@@ -0,0 +1,96 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * checkpoint.h: Training state for resuming a run, and schedules of training stages
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * the state of a serial training run besides the weight tables, saved as lines of key=value
+ * the weights are saved alongside, in the file named by the path suffixed with ".weights"
+ *
+ * a checkpoint is taken between games, or during a game when the run is interrupted,
+ * in which case the game in progress is kept and continued after resuming; it is removed
+ * once the run is complete; only the serial training loop takes checkpoints
+ */
+class checkpoint {
+public:
+	/**
+	 * a stage of the schedule, which plays a number of games with its own seed and alpha
+	 * the format of a schedule is "seed:games[:alpha],...", e.g., "305679:400,136599:400:0.1"
+	 */
+	struct stage {
+		std::string seed;
+		size_t games;
+		std::string alpha;
+	};
+
+	static std::vector<stage> schedule(const std::string& text) {
+		std::vector<stage> plan;
+		std::stringstream list(text);
+		for (std::string item; std::getline(list, item, ','); ) {
+			std::stringstream fields(item);
+			std::string seed, games, alpha;
+			std::getline(fields, seed, ':');
+			std::getline(fields, games, ':');
+			std::getline(fields, alpha, ':');
+			plan.push_back({ seed, games.size() ? std::stoull(games) : 0, alpha });
+		}
+		return plan;
+	}
+
+public:
+	checkpoint() : position(0), played(0), episodes(0) {}
+
+	/**
+	 * load the state, return false if there is no checkpoint
+	 */
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::in);
+		if (!in.is_open()) return false;
+		for (std::string line; std::getline(in, line); ) {
+			std::string key = line.substr(0, line.find('='));
+			std::string value = line.substr(line.find('=') + 1);
+			if (key == "position") position = std::stoull(value);
+			if (key == "played") played = std::stoull(value);
+			if (key == "episodes") episodes = std::stoull(value);
+			if (key == "player") player = value;
+			if (key == "environment") environment = value;
+			if (key == "game") game = value;
+		}
+		return true;
+	}
+	/**
+	 * save the state through a temporary file, so that an existing checkpoint is never left partial
+	 */
+	void save(const std::string& path) const {
+		std::ofstream out(path + ".tmp", std::ios::out | std::ios::trunc);
+		if (!out.is_open()) std::exit(-1);
+		out << "position=" << position << std::endl;
+		out << "played=" << played << std::endl;
+		out << "episodes=" << episodes << std::endl;
+		out << "player=" << player << std::endl;
+		out << "environment=" << environment << std::endl;
+		if (game.size()) out << "game=" << game << std::endl;
+		out.close();
+		std::rename((path + ".tmp").c_str(), path.c_str());
+	}
+
+public:
+	size_t position; // the index of the current stage in the schedule
+	size_t played; // the games finished in the current stage
+	size_t episodes; // the episodes counted by the statistic, excluding the game in progress
+	std::string player; // the state of the player, see player::save_state
+	std::string environment; // the state of the environment, see random_agent::save_state
+	std::string game; // the game in progress, or empty if the checkpoint is between games
+};
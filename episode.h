@@ -15,6 +15,7 @@
 #include <sstream>
 #include <chrono>
 #include <numeric>
+#include <functional>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
@@ -24,12 +25,35 @@ class statistic;
 class episode {
 friend class statistic;
 public:
-	episode() : ep_state(initial_state()), ep_score(0), ep_time(0) { ep_moves.reserve(10000); }
+	episode() : episode(initial_state()) {}
+	explicit episode(const board& start) : ep_state(start), ep_start(start), ep_score(0), ep_time(0) { ep_moves.reserve(10000); }
 
 public:
 	board& state() { return ep_state; }
 	const board& state() const { return ep_state; }
 	board::reward score() const { return ep_score; }
+	const board& start() const { return ep_start; }
+
+	/**
+	 * the hook of the initial state of new episodes, e.g., to start the training games
+	 * from a pool of states (see start_pool), which should be set before any game starts
+	 */
+	static std::function<board()>& initial_hook() {
+		static std::function<board()> hook;
+		return hook;
+	}
+
+	/**
+	 * reset to a new episode, keeping the storage of the moves for reuse
+	 */
+	void clear() {
+		ep_state = ep_start = initial_state();
+		ep_score = 0;
+		ep_moves.clear();
+		ep_time = 0;
+		ep_open = {};
+		ep_close = {};
+	}
 
 	void open_episode(const std::string& tag) {
 		ep_open = { tag, millisec() };
@@ -98,25 +122,37 @@ public:
 
 public:
 
+	/**
+	 * the format is "open|moves|close", followed by "|start" if the episode does not start
+	 * from an empty board, where start is the tiles in hexadecimal, two digits for each
+	 */
 	friend std::ostream& operator <<(std::ostream& out, const episode& ep) {
 		out << ep.ep_open << '|';
 		for (const move& mv : ep.ep_moves) out << mv;
 		out << '|' << ep.ep_close;
+		if (ep.ep_start != board()) {
+			out << '|';
+			for (int i = 0; i < 16; i++) out << "0123456789abcdef"[(ep.ep_start(i) >> 4) & 15] << "0123456789abcdef"[ep.ep_start(i) & 15];
+		}
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, episode& ep) {
-		ep = {};
-		std::string token;
-		std::getline(in, token, '|');
-		std::stringstream(token) >> ep.ep_open;
-		std::getline(in, token, '|');
-		for (std::stringstream moves(token); !moves.eof(); moves.peek()) {
+		ep = episode(board()); // recorded episodes start from an empty board unless told otherwise
+		std::string open, moves, close, start;
+		std::getline(in, open, '|');
+		std::getline(in, moves, '|');
+		std::getline(in, close, '|');
+		if (in.good()) std::getline(in, start, '|');
+		std::stringstream(open) >> ep.ep_open;
+		std::stringstream(close) >> ep.ep_close;
+		for (int i = 0; i < 16 && start.size() >= 32; i++)
+			ep.ep_start(i) = std::stoul(start.substr(i * 2, 2), nullptr, 16);
+		ep.ep_state = ep.ep_start;
+		for (std::stringstream list(moves); !list.eof(); list.peek()) {
 			ep.ep_moves.emplace_back();
-			moves >> ep.ep_moves.back();
+			list >> ep.ep_moves.back();
 			ep.ep_score += action(ep.ep_moves.back()).apply(ep.ep_state);
 		}
-		std::getline(in, token, '|');
-		std::stringstream(token) >> ep.ep_close;
 		return in;
 	}
 
@@ -167,7 +203,7 @@ protected:
 	};
 
 	static board initial_state() {
-		return {};
+		return initial_hook() ? initial_hook()() : board();
 	}
 	static time_t millisec() {
 		auto now = std::chrono::system_clock::now().time_since_epoch();
@@ -176,6 +212,7 @@ protected:
 
 private:
 	board ep_state;
+	board ep_start;
 	board::reward ep_score;
 	std::vector<move> ep_moves;
 	time_t ep_time;
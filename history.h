@@ -0,0 +1,73 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * history.h: Reusable arena of the afterstates recorded in a game
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "board.h"
+
+/**
+ * arena of the afterstates recorded in a game, each packed one tile per byte together with
+ * its reward and feature indices, so that learning from it needs no feature extraction
+ *
+ * clearing keeps the slots, and the arena is grown between games to a margin over the longest
+ * game seen so far, so that no allocation happens in the steady state of playing and learning
+ */
+template<size_t features>
+class history_arena {
+public:
+	struct state {
+		uint8_t tile[16];
+		int32_t reward;
+		int32_t stage; // the stage of the tables which the features index
+		uint32_t feature[features];
+
+		board afterstate() const {
+			board b;
+			for (int i = 0; i < 16; i++) b(i) = tile[i];
+			return b;
+		}
+	};
+
+	history_arena(size_t capacity = 0) : slots(capacity), count(0), longest(0) {}
+
+public:
+	/**
+	 * append an afterstate and return its slot, whose features are left to the caller
+	 */
+	state& push(const board& afterstate, int reward) {
+		if (count == slots.size()) slots.resize(std::max(slots.size() * 2, size_t(256)));
+		state& s = slots[count++];
+		for (int i = 0; i < 16; i++) s.tile[i] = std::min(afterstate(i), 255u);
+		s.reward = reward;
+		return s;
+	}
+	/**
+	 * forget the recorded afterstates, and learn the capacity from the length of the game
+	 */
+	void clear() {
+		longest = std::max(longest, count);
+		if (slots.size() < longest + longest / 4) slots.resize(longest + longest / 4);
+		count = 0;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t capacity() const { return slots.size(); }
+	state& operator [](size_t i) { return slots[i]; }
+	const state& operator [](size_t i) const { return slots[i]; }
+	state& back() { return slots[count - 1]; }
+	const state& back() const { return slots[count - 1]; }
+
+private:
+	std::vector<state> slots;
+	size_t count;
+	size_t longest;
+};
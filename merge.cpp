@@ -0,0 +1,274 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * merge.cpp: Tool for merging weight files trained independently
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+/**
+ * the layout of a weight file saved by weight_agent::save_weights: the number of tables (3n),
+ * followed by the n value tables, the n tables of A, and the n tables of E,
+ * each of which is its size followed by its floats
+ */
+struct layout {
+	std::vector<uint64_t> sizes;
+	std::vector<uint64_t> offsets; // the offsets of the floats of each table in the file
+
+	static layout scan(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) std::exit(-1);
+		layout file;
+		uint32_t count = 0;
+		in.read(reinterpret_cast<char*>(&count), sizeof(count));
+		if (!in || count % 3) std::exit(-1);
+		for (uint32_t i = 0; i < count; i++) {
+			uint64_t size = 0;
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+			if (!in) std::exit(-1);
+			file.sizes.push_back(size);
+			file.offsets.push_back(in.tellg());
+			in.seekg(size * sizeof(float), std::ios::cur);
+		}
+		return file;
+	}
+	size_t tables() const { return sizes.size() / 3; }
+};
+
+/**
+ * merge the weight files chunk by chunk, where each chunk is a range of entries of a value table,
+ * together with the same range of its A and E tables, so that the files are never loaded at once
+ *
+ * the modes of merging a value table are
+ * average: the plain average of the files
+ * visits: the average weighted by the A of each entry, i.e., how much the entry has been trained,
+ *         which falls back to the plain average for the entries not trained by any file
+ * select: the table of a single file, given by "table:file" in --select, or otherwise the file
+ *         whose table has the largest total A
+ * the A and E tables go along with the value tables, which are averaged except in select mode
+ */
+class merger {
+public:
+	merger(const std::vector<std::string>& inputs, const std::string& mode, size_t chunk)
+		: inputs(inputs), mode(mode), chunk(chunk), file(layout::scan(inputs.at(0))) {
+		for (size_t k = 1; k < inputs.size(); k++) {
+			if (layout::scan(inputs[k]).sizes != file.sizes) std::exit(-1); // the networks do not match
+		}
+		choice.assign(file.tables(), -1);
+	}
+
+public:
+	/**
+	 * let a value table be taken from the given file in select mode
+	 */
+	void select(size_t table, int from) {
+		if (table >= choice.size() || from < 0 || size_t(from) >= inputs.size()) std::exit(-1);
+		choice[table] = from;
+	}
+
+	void run(const std::string& output, size_t threads) {
+		if (mode == "select") choose(threads);
+		allocate(output);
+		std::vector<std::pair<size_t, uint64_t>> jobs; // the table and the first entry of each chunk
+		for (size_t t = 0; t < file.tables(); t++) {
+			for (uint64_t i = 0; i < file.sizes[t]; i += chunk) jobs.emplace_back(t, i);
+		}
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < std::max(threads, size_t(1)); id++) {
+			workers.emplace_back([this, &jobs, &next, &output]() {
+				std::vector<std::ifstream> in(inputs.size());
+				for (size_t k = 0; k < inputs.size(); k++) {
+					in[k].open(inputs[k], std::ios::in | std::ios::binary);
+					if (!in[k].is_open()) std::exit(-1);
+				}
+				std::fstream out(output, std::ios::in | std::ios::out | std::ios::binary);
+				if (!out.is_open()) std::exit(-1);
+				std::vector<float> w(inputs.size() * chunk), A(inputs.size() * chunk), E(inputs.size() * chunk);
+				std::vector<float> mw(chunk), mA(chunk), mE(chunk);
+				for (size_t j; (j = next++) < jobs.size(); ) {
+					size_t t = jobs[j].first, n = file.tables();
+					uint64_t first = jobs[j].second, len = std::min(uint64_t(chunk), file.sizes[t] - first);
+					for (size_t k = 0; k < inputs.size(); k++) {
+						read(in[k], t, first, len, &w[k * chunk]);
+						read(in[k], n + t, first, len, &A[k * chunk]);
+						read(in[k], n + n + t, first, len, &E[k * chunk]);
+					}
+					combine(t, len, w, A, E, mw, mA, mE);
+					write(out, t, first, len, mw.data());
+					write(out, n + t, first, len, mA.data());
+					write(out, n + n + t, first, len, mE.data());
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+	}
+
+protected:
+	void combine(size_t t, size_t len, const std::vector<float>& w, const std::vector<float>& A, const std::vector<float>& E,
+			std::vector<float>& mw, std::vector<float>& mA, std::vector<float>& mE) const {
+		size_t files = inputs.size();
+		if (mode == "select") {
+			size_t k = choice[t];
+			std::copy(&w[k * chunk], &w[k * chunk] + len, mw.begin());
+			std::copy(&A[k * chunk], &A[k * chunk] + len, mA.begin());
+			std::copy(&E[k * chunk], &E[k * chunk] + len, mE.begin());
+			return;
+		}
+		for (size_t i = 0; i < len; i++) {
+			double sw = 0, sA = 0, sE = 0, visits = 0, weighted = 0;
+			for (size_t k = 0; k < files; k++) {
+				sw += w[k * chunk + i];
+				sA += A[k * chunk + i];
+				sE += E[k * chunk + i];
+				visits += std::fabs(A[k * chunk + i]);
+				weighted += std::fabs(double(A[k * chunk + i])) * w[k * chunk + i];
+			}
+			mw[i] = float(mode == "visits" && visits > 0 ? weighted / visits : sw / files);
+			mA[i] = float(sA / files);
+			mE[i] = float(sE / files);
+		}
+	}
+
+	/**
+	 * choose the file of the tables not given in --select by their total A
+	 */
+	void choose(size_t threads) {
+		size_t n = file.tables();
+		std::vector<double> total(n * inputs.size());
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < std::max(threads, size_t(1)); id++) {
+			workers.emplace_back([this, n, &total, &next]() {
+				std::vector<float> buf(chunk);
+				for (size_t j; (j = next++) < n * inputs.size(); ) {
+					size_t t = j % n, k = j / n;
+					if (choice[t] != -1) continue;
+					std::ifstream in(inputs[k], std::ios::in | std::ios::binary);
+					for (uint64_t first = 0; first < file.sizes[t]; first += chunk) {
+						uint64_t len = std::min(uint64_t(chunk), file.sizes[t] - first);
+						read(in, n + t, first, len, buf.data());
+						for (size_t i = 0; i < len; i++) total[j] += std::fabs(buf[i]);
+					}
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+		for (size_t t = 0; t < n; t++) {
+			if (choice[t] != -1) continue;
+			choice[t] = 0;
+			for (size_t k = 1; k < inputs.size(); k++) {
+				if (total[k * n + t] > total[choice[t] * n + t]) choice[t] = k;
+			}
+		}
+	}
+
+	/**
+	 * create the output with the header and the table sizes, whose floats are filled by the workers
+	 */
+	void allocate(const std::string& output) const {
+		std::ofstream out(output, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) std::exit(-1);
+		uint32_t count = file.sizes.size();
+		out.write(reinterpret_cast<char*>(&count), sizeof(count));
+		for (size_t t = 0; t < file.sizes.size(); t++) {
+			out.seekp(file.offsets[t] - sizeof(uint64_t));
+			out.write(reinterpret_cast<const char*>(&file.sizes[t]), sizeof(uint64_t));
+		}
+		if (file.sizes.size() && file.sizes.back()) { // extend the file to its full length
+			char zero = 0;
+			out.seekp(file.offsets.back() + file.sizes.back() * sizeof(float) - 1);
+			out.write(&zero, 1);
+		}
+		if (!out) std::exit(-1);
+	}
+
+	void read(std::ifstream& in, size_t table, uint64_t first, uint64_t len, float* buf) const {
+		in.seekg(file.offsets[table] + first * sizeof(float));
+		in.read(reinterpret_cast<char*>(buf), len * sizeof(float));
+		if (!in) std::exit(-1);
+	}
+	void write(std::fstream& out, size_t table, uint64_t first, uint64_t len, const float* buf) const {
+		out.seekp(file.offsets[table] + first * sizeof(float));
+		out.write(reinterpret_cast<const char*>(buf), len * sizeof(float));
+		if (!out) std::exit(-1);
+	}
+
+protected:
+	std::vector<std::string> inputs;
+	std::string mode;
+	size_t chunk;
+	layout file;
+	std::vector<int> choice; // the file of each value table in select mode
+};
+
+/**
+ * whether two paths refer to the same file, by name or by device and inode where available
+ */
+bool same_file(const std::string& a, const std::string& b) {
+	if (a == b) return true;
+#if defined(__unix__) || defined(__APPLE__)
+	struct stat sa, sb;
+	if (stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0)
+		return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+	return false;
+}
+
+int main(int argc, const char* argv[]) {
+	std::cout << "2048-Merge: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
+	std::cout << std::endl << std::endl;
+
+	std::vector<std::string> inputs;
+	std::string output, mode = "average", select;
+	size_t thread = std::max(std::thread::hardware_concurrency(), 1u), chunk = 1 << 16;
+	for (int i = 1; i < argc; i++) {
+		std::string para(argv[i]);
+		if (para.find("--input=") == 0) {
+			std::stringstream list(para.substr(para.find("=") + 1));
+			for (std::string file; std::getline(list, file, ','); ) inputs.push_back(file);
+		} else if (para.find("--output=") == 0) {
+			output = para.substr(para.find("=") + 1);
+		} else if (para.find("--mode=") == 0) {
+			mode = para.substr(para.find("=") + 1);
+		} else if (para.find("--select=") == 0) {
+			select = para.substr(para.find("=") + 1);
+		} else if (para.find("--thread=") == 0) {
+			thread = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--chunk=") == 0) {
+			chunk = std::max(std::stoull(para.substr(para.find("=") + 1)), 1ull);
+		}
+	}
+	if (inputs.empty() || output.empty()) return -1;
+	if (mode != "average" && mode != "visits" && mode != "select") return -1;
+	for (const std::string& input : inputs) {
+		if (same_file(input, output)) return -1; // the output would be truncated before it is read
+	}
+
+	merger merge(inputs, mode, chunk);
+	std::stringstream list(select);
+	for (std::string item; std::getline(list, item, ','); ) {
+		merge.select(std::stoull(item.substr(0, item.find(':'))), std::stoi(item.substr(item.find(':') + 1)));
+	}
+	merge.run(output, thread);
+	return 0;
+}
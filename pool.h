@@ -0,0 +1,135 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * pool.h: Pool of intermediate states for starting the training games
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "board.h"
+#include "action.h"
+#include "episode.h"
+
+/**
+ * pool of mid- and late-game afterstates, from which the training games can start instead of
+ * the empty board, so that the rare late-game positions are trained without the long openings
+ *
+ * configured by "tile=T size=N ratio=P per=K load=a.txt,b.txt live=1 seed=S":
+ * the afterstates whose largest tile index is at least T are harvested from the recorded games
+ * in the given files (e.g., saved by --save), and from the finished games of live play,
+ * at most K from each game; the pool keeps the latest N of them, and a game starts from
+ * a state drawn uniformly from the pool with probability P
+ *
+ * the environment places its opening tiles on the start state as usual, so only afterstates
+ * with at least two empty cells are harvested
+ */
+class start_pool {
+public:
+	start_pool(const std::string& args = "") : tile(10), size(0), ratio(0.5), per(4), live(true), head(0) {
+		std::vector<std::string> files;
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('=')), value = pair.substr(pair.find('=') + 1);
+			if (key == "tile") tile = std::stoul(value);
+			if (key == "size") size = std::stoull(value);
+			if (key == "ratio") ratio = std::stod(value);
+			if (key == "per") per = std::stoull(value);
+			if (key == "live") live = std::stoi(value);
+			if (key == "seed") engine.seed(std::stoul(value));
+			if (key == "load") {
+				std::stringstream list(value);
+				for (std::string file; std::getline(list, file, ','); ) files.push_back(file);
+			}
+		}
+		if (args.size() && !size) size = 100000;
+		for (const std::string& file : files) load(file);
+	}
+
+public:
+	/**
+	 * harvest the afterstates of the recorded games in a file
+	 */
+	void load(const std::string& path) {
+		std::ifstream in(path, std::ios::in);
+		if (!in.is_open()) std::exit(-1);
+		for (std::string line; std::getline(in, line); ) {
+			if (line.empty()) continue;
+			episode game;
+			std::stringstream(line) >> game;
+			harvest(game);
+		}
+	}
+	/**
+	 * harvest the afterstates of a finished game of live play
+	 */
+	void observe(const episode& game) {
+		if (live) harvest(game);
+	}
+
+	/**
+	 * draw the start state of a new game, which is the empty board with probability 1 - P
+	 */
+	board draw() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (states.empty() || std::uniform_real_distribution<double>(0, 1)(engine) >= ratio) return {};
+		return states[std::uniform_int_distribution<size_t>(0, states.size() - 1)(engine)];
+	}
+	/**
+	 * let the new episodes start from the pool
+	 */
+	void install() {
+		episode::initial_hook() = [this]() { return draw(); };
+	}
+
+	size_t count() const { return states.size(); }
+
+protected:
+	/**
+	 * rebuild the afterstates of a game, then keep at most K eligible ones drawn uniformly
+	 */
+	void harvest(const episode& game) {
+		if (!size) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		eligible.clear();
+		board state = game.start();
+		for (action move : game.actions()) {
+			if (move.apply(state) == -1) break;
+			if (move.type() != action::slide::type) continue;
+			unsigned top = 0, empty = 0;
+			for (int i = 0; i < 16; i++) {
+				top = std::max(top, state(i));
+				empty += state(i) == 0;
+			}
+			if (top >= tile && empty >= 2) eligible.push_back(state);
+		}
+		for (size_t k = 0; k < per && eligible.size(); k++) {
+			size_t i = std::uniform_int_distribution<size_t>(0, eligible.size() - 1)(engine);
+			if (states.size() < size) states.push_back(eligible[i]);
+			else states[head] = eligible[i];
+			head = (head + 1) % size;
+			eligible[i] = eligible.back();
+			eligible.pop_back();
+		}
+	}
+
+protected:
+	unsigned tile;
+	size_t size;
+	double ratio;
+	size_t per;
+	bool live;
+	std::vector<board> states;
+	std::vector<board> eligible;
+	size_t head;
+	std::mt19937 engine;
+	std::mutex mutex;
+};
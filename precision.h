@@ -0,0 +1,124 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * precision.h: Reduced-precision storage of the TC statistics
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "weight.h"
+
+/**
+ * IEEE 754 half precision, converted with round-to-nearest-even
+ * values beyond the range saturate to the largest finite value (65504) instead of infinity
+ */
+struct half {
+	uint16_t bits;
+
+	half(float f = 0) : bits(encode(f)) {}
+	operator float() const { return decode(bits); }
+	static float ceiling() { return 32768; }
+
+	static uint16_t encode(float f) {
+		uint32_t x;
+		std::memcpy(&x, &f, sizeof(x));
+		uint32_t sign = (x >> 16) & 0x8000, abs = x & 0x7fffffff;
+		if (abs > 0x7f800000) return sign | 0x7e00; // NaN
+		if (abs >= 0x477fe000) return sign | 0x7bff; // saturate
+		if (abs < 0x38800000) { // subnormal, rounded by the addition
+			float magic = 0.5f;
+			std::memcpy(&f, &abs, sizeof(f));
+			f += magic;
+			std::memcpy(&x, &f, sizeof(x));
+			return sign | uint16_t(x - 0x3f000000);
+		}
+		abs += 0xc8000fff + ((abs >> 13) & 1); // rebias the exponent and round
+		return sign | uint16_t(abs >> 13);
+	}
+	static float decode(uint16_t h) {
+		uint32_t x = uint32_t(h & 0x7fff) << 13, exp = x & 0x0f800000;
+		float f;
+		if (exp == 0x0f800000) { // infinity or NaN
+			x += 0x70000000;
+		} else if (exp == 0) { // subnormal
+			x += 0x38800000;
+			std::memcpy(&f, &x, sizeof(f));
+			f -= 6.103515625e-05f;
+			std::memcpy(&x, &f, sizeof(x));
+		} else {
+			x += 0x38000000;
+		}
+		x |= uint32_t(h & 0x8000) << 16;
+		std::memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+};
+
+/**
+ * bfloat16, the upper half of a float, converted with round-to-nearest-even
+ * values beyond the range saturate to the largest finite value instead of infinity
+ */
+struct bfloat16 {
+	uint16_t bits;
+
+	bfloat16(float f = 0) : bits(encode(f)) {}
+	operator float() const { return decode(bits); }
+	static float ceiling() { return 32768; }
+
+	static uint16_t encode(float f) {
+		uint32_t x;
+		std::memcpy(&x, &f, sizeof(x));
+		uint32_t sign = (x >> 16) & 0x8000, abs = x & 0x7fffffff;
+		if (abs > 0x7f800000) return sign | 0x7fc0; // NaN
+		if (abs >= 0x7f7f8000) return sign | 0x7f7f; // saturate
+		return uint16_t((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+	}
+	static float decode(uint16_t b) {
+		uint32_t x = uint32_t(b) << 16;
+		float f;
+		std::memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+};
+
+/**
+ * the storage type of the TC statistics (net_E and net_A), selected at compile time
+ * by -DTC_FP16 or -DTC_BF16; the value tables are always floats
+ *
+ * half is supported, and trains close to float; bfloat16 is experimental, since its 8-bit
+ * mantissa loses the small increments of A (about 12% lower scores in a smoke test)
+ * both are checked by "make check" (precision_check.cpp)
+ */
+#if defined(TC_FP16)
+typedef half tc_type;
+#elif defined(TC_BF16)
+typedef bfloat16 tc_type;
+#else
+typedef float tc_type;
+#endif
+typedef table<tc_type> tc_table;
+
+/**
+ * accumulate a TD error into the TC statistics of an entry
+ *
+ * only the ratio |E|/A is used, so a 16-bit pair is halved once A exceeds the ceiling,
+ * which keeps A away from saturation and keeps the increments above the rounding of A
+ */
+inline void tc_accumulate(float& E, float& A, float delta, float error) {
+	E += delta;
+	A += error;
+}
+template<typename type>
+inline void tc_accumulate(type& E, type& A, float delta, float error) {
+	float e = float(E) + delta, a = float(A) + error;
+	if (a > type::ceiling()) {
+		e *= 0.5f;
+		a *= 0.5f;
+	}
+	E = e;
+	A = a;
+}
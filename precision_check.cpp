@@ -0,0 +1,124 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * precision_check.cpp: Checks of the reduced-precision TC statistics
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include "precision.h"
+
+static int failures = 0;
+
+static void check(bool pass, const std::string& what) {
+	std::cout << (pass ? "PASS " : "FAIL ") << what << std::endl;
+	if (!pass) failures++;
+}
+
+/**
+ * every finite pattern is decoded and encoded back to itself, infinity saturates, and NaN stays NaN
+ */
+template<typename type>
+static void round_trip(uint16_t inf, uint16_t largest, const std::string& name) {
+	size_t wrong = 0;
+	for (uint32_t bits = 0; bits <= 0xffff; bits++) {
+		uint16_t b = bits, sign = b & 0x8000;
+		float f = type::decode(b);
+		uint16_t back = type::encode(f);
+		if ((b & 0x7fff) == inf) wrong += back != (sign | largest);
+		else if (std::isnan(f)) wrong += !std::isnan(type::decode(back));
+		else wrong += back != b;
+	}
+	check(wrong == 0, name + " round trip of all bit patterns");
+}
+
+/**
+ * the midpoint of two neighbors is rounded to the even one, and a float just off it to the nearer one
+ */
+template<typename type>
+static void round_to_nearest_even(uint16_t largest, const std::string& name) {
+	size_t wrong = 0;
+	for (uint32_t bits = 0; bits < largest; bits++) {
+		float lo = type::decode(bits), hi = type::decode(bits + 1);
+		float mid = float((double(lo) + double(hi)) / 2);
+		uint16_t even = (bits & 1) ? bits + 1 : bits;
+		wrong += type::encode(mid) != even;
+		wrong += type::encode(std::nextafter(mid, lo)) != bits;
+		wrong += type::encode(std::nextafter(mid, hi)) != bits + 1;
+		wrong += type::encode(-mid) != (0x8000 | even);
+	}
+	check(wrong == 0, name + " round to nearest even");
+}
+
+/**
+ * the values beyond the range saturate to the largest finite value of their sign
+ */
+template<typename type>
+static void saturation(uint16_t largest, const std::string& name) {
+	float beyond = std::nextafter(type::decode(largest), std::numeric_limits<float>::max()) * 2;
+	bool pass = type::encode(beyond) == largest && type::encode(-beyond) == (0x8000 | largest)
+		&& type::encode(std::numeric_limits<float>::max()) == largest
+		&& type::encode(std::numeric_limits<float>::infinity()) == largest
+		&& type::encode(-std::numeric_limits<float>::infinity()) == (0x8000 | largest)
+		&& !std::isinf(float(type(1e30f))) && !std::isinf(float(type(-1e30f)));
+	check(pass, name + " saturation");
+}
+
+/**
+ * train a synthetic linear value function by TC learning as player::update_features does,
+ * where each sample is the sum of 8 entries out of a table, then return the test error (RMSE)
+ */
+template<typename type>
+static double train(size_t steps) {
+	const size_t entries = 512, features = 8;
+	const float alpha = 0.1f, epsilon = 1e-5f;
+	std::mt19937 engine(7);
+	std::uniform_int_distribution<size_t> pick(0, entries - 1);
+	std::normal_distribution<float> noise(0, 10);
+	std::vector<float> truth(entries), net(entries, 0);
+	for (float& t : truth) t = std::uniform_real_distribution<float>(0, 1000)(engine);
+	std::vector<type> E(entries, type(epsilon)), A(entries, type(epsilon));
+	std::vector<size_t> feature(features);
+	for (size_t s = 0; s < steps; s++) {
+		float target = 0, value = 0;
+		for (size_t& f : feature) {
+			f = pick(engine);
+			target += truth[f];
+			value += net[f];
+		}
+		float delta = target + noise(engine) - value, step = alpha * delta;
+		for (size_t f : feature) {
+			float learning_rate = std::fabs(float(E[f])) / float(A[f]);
+			net[f] += step * learning_rate / features;
+			tc_accumulate(E[f], A[f], delta / features, std::fabs(delta / features));
+		}
+	}
+	double error = 0;
+	for (size_t i = 0; i < entries; i++) error += (net[i] - truth[i]) * (net[i] - truth[i]);
+	return std::sqrt(error / entries);
+}
+
+int main() {
+	round_trip<half>(0x7c00, 0x7bff, "half");
+	round_trip<bfloat16>(0x7f80, 0x7f7f, "bfloat16");
+	round_to_nearest_even<half>(0x7bff, "half");
+	round_to_nearest_even<bfloat16>(0x7f7f, "bfloat16");
+	saturation<half>(0x7bff, "half");
+	saturation<bfloat16>(0x7f7f, "bfloat16");
+
+	size_t steps = 400000;
+	double fp32 = train<float>(steps), fp16 = train<half>(steps), bf16 = train<bfloat16>(steps);
+	std::cout << "synthetic TC training RMSE: float " << fp32 << ", half " << fp16 << ", bfloat16 " << bf16 << std::endl;
+	check(fp16 <= fp32 * 1.2, "half trains within 20% of float");
+	check(bf16 <= fp32 * 1.5, "bfloat16 trains within 50% of float (experimental)");
+
+	std::cout << (failures ? "FAILED" : "ALL PASSED") << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * queue.h: Lock-free queues for passing data between training threads
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+/**
+ * bounded lock-free multi-producer single-consumer queue
+ * each cell carries a sequence number telling whether it is ready for writing or reading,
+ * so producers only contend on the tail and the consumer never contends at all
+ *
+ * the depth is rounded up to a power of two
+ */
+template<typename type>
+class mpsc_queue {
+public:
+	mpsc_queue(size_t depth) : cells(capacity(depth)), mask(cells.size() - 1), head(0), tail(0) {
+		for (size_t i = 0; i < cells.size(); i++) cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+public:
+	/**
+	 * push an item, which is moved only if the push succeeds
+	 * return false if the queue is full
+	 */
+	bool push(type&& item) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		cell* c;
+		while (true) {
+			c = &cells[pos & mask];
+			size_t seq = c->seq.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(seq) - intptr_t(pos);
+			if (diff == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+		c->data = std::move(item);
+		c->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * pop an item, should only be called by the single consumer
+	 * return false if the queue is empty
+	 */
+	bool pop(type& item) {
+		cell& c = cells[head & mask];
+		if (c.seq.load(std::memory_order_acquire) != head + 1) return false;
+		item = std::move(c.data);
+		c.seq.store(head + mask + 1, std::memory_order_release);
+		head++;
+		return true;
+	}
+
+	size_t depth() const { return cells.size(); }
+
+protected:
+	static size_t capacity(size_t depth) {
+		size_t n = 1;
+		while (n < depth) n <<= 1;
+		return n;
+	}
+
+	struct cell {
+		std::atomic<size_t> seq;
+		type data;
+	};
+
+	std::vector<cell> cells;
+	size_t mask;
+	size_t head;
+	char padding[64]; // keep the head and the tail on different cache lines
+	std::atomic<size_t> tail;
+};
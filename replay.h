@@ -0,0 +1,153 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * replay.h: Experience replay buffer of afterstate transitions
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <string>
+#include <random>
+#include <mutex>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include "board.h"
+
+/**
+ * a transition from an afterstate to the next afterstate, in a compact binary form
+ * the tiles are packed one per byte, and the feature indices of the afterstate are kept
+ * so that learning from it needs no feature extraction
+ */
+struct experience {
+	uint8_t before[16]; // the afterstate
+	uint8_t after[16]; // the next afterstate, undefined if terminal
+	int32_t reward; // the reward of reaching the next afterstate
+	uint32_t terminal;
+	uint32_t stage; // the stage of the tables which the features index
+	uint32_t feature[32]; // the feature indices of the afterstate
+
+	static void pack(uint8_t* cell, const board& b) {
+		for (int i = 0; i < 16; i++) cell[i] = std::min(b(i), 255u);
+	}
+	static board unpack(const uint8_t* cell) {
+		board b;
+		for (int i = 0; i < 16; i++) b(i) = cell[i];
+		return b;
+	}
+};
+
+/**
+ * ring buffer of transitions with uniform, prioritized, and recency-weighted sampling
+ *
+ * the prioritized sampling draws a transition with probability proportional to its priority,
+ * usually the last |TD error|, through a sum tree; new transitions get the maximal priority
+ * the recency-weighted sampling draws the age of a transition from a geometric distribution
+ *
+ * a buffer shared by several threads is locked through guard() by its users
+ */
+class replay_buffer {
+public:
+	replay_buffer(size_t capacity = 0, const std::string& mode = "uniform", unsigned seed = std::mt19937::default_seed)
+		: records(capacity), tree(2 * leaves(capacity)), head(0), count(0), top(1),
+		  mode(mode), recency(std::max(capacity / 8, size_t(1))), engine(seed) {}
+
+public:
+	size_t size() const { return count; }
+	size_t capacity() const { return records.size(); }
+	experience& at(size_t i) { return records[i]; }
+	std::mutex& guard() { return mutex; }
+
+	/**
+	 * store a transition, which overwrites the oldest one if the buffer is full
+	 */
+	void push(const experience& e) {
+		if (records.empty()) return;
+		records[head] = e;
+		prioritize(head, top);
+		head = (head + 1) % records.size();
+		count = std::min(count + 1, records.size());
+	}
+
+	/**
+	 * draw the index of a transition by the sampling mode
+	 */
+	size_t sample() {
+		if (mode == "priority") return sample_priority();
+		if (mode == "recent") return sample_recent();
+		return sample_uniform();
+	}
+	size_t sample_uniform() {
+		return std::uniform_int_distribution<size_t>(0, count - 1)(engine);
+	}
+	size_t sample_priority() {
+		float mass = std::uniform_real_distribution<float>(0, tree[1])(engine);
+		size_t node = 1;
+		while (node < tree.size() / 2) {
+			node <<= 1;
+			if (mass >= tree[node] && tree[node + 1] > 0) mass -= tree[node++];
+		}
+		return std::min(node - tree.size() / 2, count - 1);
+	}
+	size_t sample_recent() {
+		size_t age = std::geometric_distribution<size_t>(1.0 / recency)(engine) % count;
+		return (head + records.size() - 1 - age) % records.size();
+	}
+
+	/**
+	 * update the priority of a transition, e.g., by its latest |TD error|
+	 */
+	void prioritize(size_t i, float priority) {
+		top = std::max(top, priority);
+		size_t node = i + tree.size() / 2;
+		float diff = priority - tree[node];
+		for (; node; node >>= 1) tree[node] += diff;
+	}
+
+public:
+	/**
+	 * the binary format is a header of magic, record size, and count, followed by the records
+	 * from the oldest to the newest
+	 */
+	void save(const std::string& path) const {
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return;
+		uint64_t header[3] = { magic, sizeof(experience), count };
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		for (size_t n = 0, i = (head + records.size() - count) % records.size(); n < count; n++, i = (i + 1) % records.size())
+			out.write(reinterpret_cast<const char*>(&records[i]), sizeof(experience));
+	}
+	void load(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) return;
+		uint64_t header[3] = { 0 };
+		in.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (header[0] != magic || header[1] != sizeof(experience)) return;
+		experience e;
+		for (uint64_t n = 0; n < header[2] && in.read(reinterpret_cast<char*>(&e), sizeof(e)); n++) push(e);
+	}
+
+protected:
+	static size_t leaves(size_t capacity) {
+		size_t n = 1;
+		while (n < capacity) n <<= 1;
+		return n;
+	}
+
+	static constexpr uint64_t magic = 0x594c504552383430ull; // "048REPLY"
+
+	std::vector<experience> records;
+	std::vector<float> tree; // sum tree of the priorities, where the root is at index 1
+	size_t head;
+	size_t count;
+	float top;
+	std::string mode;
+	size_t recency;
+	std::mt19937 engine;
+	std::mutex mutex;
+};
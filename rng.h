@@ -0,0 +1,238 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * rng.h: Fast random engines with independent streams
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+/**
+ * the engines below meet the requirements of the standard distributions, and are seeded by
+ * a seed and a stream, so that the workers of the same seed can draw from independent streams
+ */
+
+/**
+ * SplitMix64, which expands the seed and the stream into the states of the other engines
+ */
+inline uint64_t splitmix64(uint64_t& x) {
+	uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/**
+ * xoshiro256** by Blackman and Vigna, whose state is hashed from the seed and the stream
+ */
+class xoshiro256 {
+public:
+	typedef uint64_t result_type;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	xoshiro256(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		uint64_t x = seed ^ splitmix64(stream);
+		for (uint64_t& v : s) v = splitmix64(x);
+	}
+	result_type operator ()() {
+		uint64_t result = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	friend std::ostream& operator <<(std::ostream& out, const xoshiro256& e) {
+		return out << e.s[0] << ' ' << e.s[1] << ' ' << e.s[2] << ' ' << e.s[3];
+	}
+	friend std::istream& operator >>(std::istream& in, xoshiro256& e) {
+		return in >> e.s[0] >> e.s[1] >> e.s[2] >> e.s[3];
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+	uint64_t s[4];
+};
+
+/**
+ * PCG64 (XSL RR 128/64) by O'Neill, where the stream selects the increment of the LCG
+ */
+class pcg64 {
+public:
+	typedef uint64_t result_type;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	pcg64(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		inc = (uint128(stream) << 1) | 1;
+		state = 0;
+		step();
+		state += seed;
+		step();
+	}
+	result_type operator ()() {
+		step();
+		uint64_t x = uint64_t(state >> 64) ^ uint64_t(state);
+		unsigned rot = unsigned(state >> 122);
+		return (x >> rot) | (x << ((64 - rot) & 63));
+	}
+
+	friend std::ostream& operator <<(std::ostream& out, const pcg64& e) {
+		return out << uint64_t(e.state >> 64) << ' ' << uint64_t(e.state) << ' ' << uint64_t(e.inc >> 64) << ' ' << uint64_t(e.inc);
+	}
+	friend std::istream& operator >>(std::istream& in, pcg64& e) {
+		uint64_t v[4] = { 0 };
+		in >> v[0] >> v[1] >> v[2] >> v[3];
+		e.state = (uint128(v[0]) << 64) | v[1];
+		e.inc = (uint128(v[2]) << 64) | v[3];
+		return in;
+	}
+
+private:
+	typedef unsigned __int128 uint128;
+	void step() {
+		const uint128 mult = (uint128(0x2360ed051fc65da4ull) << 64) | 0x4385df649fccf645ull;
+		state = state * mult + inc;
+	}
+	uint128 state;
+	uint128 inc;
+};
+
+/**
+ * Philox4x32-10 by Salmon et al., a counter-based engine whose output is the encryption of
+ * the counter (block, stream) under the key of the seed, so that any stream is independent
+ * and the streams of the workers can be derived without any state, e.g., one per game
+ */
+class philox {
+public:
+	typedef uint64_t result_type;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	philox(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		key[0] = uint32_t(seed);
+		key[1] = uint32_t(seed >> 32);
+		counter[0] = counter[1] = 0;
+		counter[2] = uint32_t(stream);
+		counter[3] = uint32_t(stream >> 32);
+		block[0] = block[1] = block[2] = block[3] = 0;
+		index = 2;
+	}
+	result_type operator ()() {
+		if (index == 2) {
+			generate();
+			if (++counter[0] == 0) ++counter[1];
+			index = 0;
+		}
+		uint64_t result = (uint64_t(block[index * 2 + 1]) << 32) | block[index * 2];
+		index++;
+		return result;
+	}
+
+	/**
+	 * encrypt the current counter into the block
+	 */
+	void generate() {
+		uint32_t c[4] = { counter[0], counter[1], counter[2], counter[3] }, k[2] = { key[0], key[1] };
+		for (int round = 0; round < 10; round++) {
+			if (round) {
+				k[0] += 0x9e3779b9u;
+				k[1] += 0xbb67ae85u;
+			}
+			uint64_t p0 = uint64_t(0xd2511f53u) * c[0], p1 = uint64_t(0xcd9e8d57u) * c[2];
+			uint32_t next[4] = { uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1), uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0) };
+			for (int i = 0; i < 4; i++) c[i] = next[i];
+		}
+		for (int i = 0; i < 4; i++) block[i] = c[i];
+	}
+
+	friend std::ostream& operator <<(std::ostream& out, const philox& e) {
+		out << e.key[0] << ' ' << e.key[1];
+		for (uint32_t c : e.counter) out << ' ' << c;
+		for (uint32_t b : e.block) out << ' ' << b;
+		return out << ' ' << e.index;
+	}
+	friend std::istream& operator >>(std::istream& in, philox& e) {
+		in >> e.key[0] >> e.key[1];
+		for (uint32_t& c : e.counter) in >> c;
+		for (uint32_t& b : e.block) in >> b;
+		return in >> e.index;
+	}
+
+private:
+	uint32_t key[2];
+	uint32_t counter[4];
+	uint32_t block[4];
+	unsigned index; // the next 64-bit output in the block, or 2 if the block is used up
+};
+
+/**
+ * K lanes of xoshiro256** in structure-of-arrays layout, where lane i is the stream
+ * (first + i) of the seed; all lanes are advanced together by a loop without any branch,
+ * which the compiler can vectorize
+ */
+class xoshiro256_lanes {
+public:
+	xoshiro256_lanes(size_t lanes = 0, uint64_t seed = 0, uint64_t first = 0) : s(4, std::vector<uint64_t>(lanes)), out(lanes) {
+		this->seed(seed, first);
+	}
+
+	size_t size() const { return out.size(); }
+
+	void seed(uint64_t seed, uint64_t first = 0) {
+		for (size_t i = 0; i < size(); i++) {
+			uint64_t stream = first + i, x = seed ^ splitmix64(stream); // as xoshiro256 (seed, first + i)
+			for (int k = 0; k < 4; k++) s[k][i] = splitmix64(x);
+		}
+	}
+	/**
+	 * draw the next output of every lane
+	 */
+	const std::vector<uint64_t>& operator ()() {
+		uint64_t* s0 = s[0].data(), * s1 = s[1].data(), * s2 = s[2].data(), * s3 = s[3].data(), * r = out.data();
+		for (size_t i = 0; i < out.size(); i++) {
+			uint64_t x = s1[i] * 5;
+			r[i] = ((x << 7) | (x >> 57)) * 9;
+			uint64_t t = s1[i] << 17;
+			s2[i] ^= s0[i];
+			s3[i] ^= s1[i];
+			s1[i] ^= s2[i];
+			s0[i] ^= s3[i];
+			s2[i] ^= t;
+			s3[i] = (s3[i] << 45) | (s3[i] >> 19);
+		}
+		return out;
+	}
+
+	friend std::ostream& operator <<(std::ostream& out, const xoshiro256_lanes& e) {
+		out << e.size();
+		for (const std::vector<uint64_t>& lane : e.s) for (uint64_t v : lane) out << ' ' << v;
+		return out;
+	}
+	friend std::istream& operator >>(std::istream& in, xoshiro256_lanes& e) {
+		size_t lanes = 0;
+		in >> lanes;
+		e = xoshiro256_lanes(lanes);
+		for (std::vector<uint64_t>& lane : e.s) for (uint64_t& v : lane) in >> v;
+		return in;
+	}
+
+private:
+	std::vector<std::vector<uint64_t>> s;
+	std::vector<uint64_t> out;
+};
@@ -0,0 +1,305 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * server.h: Parameter server owning the weight tables over Unix domain sockets
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "weight.h"
+#include "update.h"
+#include "precision.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#define PARAMETER_SERVER_SUPPORTED
+#endif
+
+/**
+ * the binary protocol between the parameter server and its workers
+ *
+ * every request is a fixed header followed by its payload, all in the native byte order
+ * layout: no payload, replied with the number of tables and their span
+ * update: count update records, replied with the new values of their keys
+ * read: count keys (uint32), replied with their values
+ */
+struct parameter_protocol {
+	enum opcode : uint32_t { layout = 'L', update = 'U', read = 'R' };
+	struct header {
+		uint32_t op;
+		uint32_t count;
+	};
+
+	static bool send(int fd, const void* data, size_t size) {
+#ifdef PARAMETER_SERVER_SUPPORTED
+		const char* p = static_cast<const char*>(data);
+		while (size) {
+			ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+	static bool receive(int fd, void* data, size_t size) {
+#ifdef PARAMETER_SERVER_SUPPORTED
+		char* p = static_cast<char*>(data);
+		while (size) {
+			ssize_t n = ::recv(fd, p, size, 0);
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+};
+
+/**
+ * the process owning the weight tables, which serves the value reads and applies the updates
+ * of the worker processes connected to a Unix domain socket, each served by a thread
+ *
+ * the updates of a message are applied in address order under a single lock, while the reads
+ * are lock-free as in hogwild
+ */
+class parameter_server {
+public:
+	parameter_server(std::vector<weight>& net, std::vector<tc_table>& net_E, std::vector<tc_table>& net_A, size_t span)
+		: net(net), net_E(net_E), net_A(net_A), span(span) {}
+
+public:
+	/**
+	 * serve the workers at the socket path until stopped, then disconnect the workers
+	 */
+	void serve(const std::string& path, const std::function<bool()>& stopped) {
+#ifdef PARAMETER_SERVER_SUPPORTED
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr = address(path);
+		::unlink(path.c_str());
+		if (fd == -1 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0) std::exit(-1);
+		std::vector<std::thread> workers;
+		std::vector<int> clients;
+		while (!stopped()) {
+			pollfd wait = { fd, POLLIN, 0 };
+			if (poll(&wait, 1, 100) <= 0) continue;
+			int client = accept(fd, nullptr, nullptr);
+			if (client == -1) continue;
+			clients.push_back(client);
+			workers.emplace_back(&parameter_server::session, this, client);
+		}
+		close(fd);
+		::unlink(path.c_str());
+		for (int client : clients) shutdown(client, SHUT_RDWR);
+		for (std::thread& worker : workers) worker.join();
+		for (int client : clients) close(client);
+#else
+		std::exit(-1);
+#endif
+	}
+
+protected:
+	/**
+	 * the loop of a worker connection, which exits once the worker leaves
+	 */
+	void session(int fd) {
+#ifdef PARAMETER_SERVER_SUPPORTED
+		update_buffer updates;
+		std::vector<update> records;
+		std::vector<uint32_t> keys;
+		std::vector<float> values;
+		uint64_t total = net.size() * span;
+		for (parameter_protocol::header req; parameter_protocol::receive(fd, &req, sizeof(req)); ) {
+			if (req.op == parameter_protocol::layout) {
+				uint64_t reply[2] = { net.size(), span };
+				if (!parameter_protocol::send(fd, reply, sizeof(reply))) break;
+			} else if (req.op == parameter_protocol::update) {
+				records.resize(req.count);
+				if (!parameter_protocol::receive(fd, records.data(), sizeof(update) * req.count)) break;
+				if (std::any_of(records.begin(), records.end(), [total](const update& u) { return u.key >= total; })) break;
+				for (const update& u : records) updates.push(u);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					updates.apply(net, net_E, net_A, span);
+				}
+				values.resize(req.count);
+				for (size_t i = 0; i < records.size(); i++) values[i] = net[records[i].key / span][records[i].key % span];
+				if (!parameter_protocol::send(fd, values.data(), sizeof(float) * values.size())) break;
+			} else if (req.op == parameter_protocol::read) {
+				keys.resize(req.count);
+				if (!parameter_protocol::receive(fd, keys.data(), sizeof(uint32_t) * req.count)) break;
+				if (std::any_of(keys.begin(), keys.end(), [total](uint32_t key) { return key >= total; })) break;
+				values.resize(req.count);
+				for (size_t i = 0; i < keys.size(); i++) values[i] = net[keys[i] / span][keys[i] % span];
+				if (!parameter_protocol::send(fd, values.data(), sizeof(float) * values.size())) break;
+			} else {
+				break;
+			}
+		}
+#endif
+	}
+
+#ifdef PARAMETER_SERVER_SUPPORTED
+public:
+	static sockaddr_un address(const std::string& path) {
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) std::exit(-1);
+		std::strcpy(addr.sun_path, path.c_str());
+		return addr;
+	}
+#endif
+
+protected:
+	std::vector<weight>& net;
+	std::vector<tc_table>& net_E;
+	std::vector<tc_table>& net_A;
+	size_t span;
+	std::mutex mutex;
+};
+
+/**
+ * the bounded cache of the values read from the parameter server by a worker
+ *
+ * the cache is direct-mapped: a key has a single slot, which holds the last value stored for
+ * any key mapped to it; a value expires after R ticks (R episodes of the worker), so that
+ * the entries updated only by other workers are read again from the server
+ */
+class parameter_cache {
+public:
+	parameter_cache(size_t capacity = 0, size_t refresh = 1) : age(0), refresh(std::max(refresh, size_t(1))), shift(32) {
+		size_t size = 1;
+		while (size < capacity && shift > 1) size <<= 1, shift--;
+		if (capacity) slots.assign(size, { 0, uint32_t(0 - this->refresh), 0 }); // expired from the start
+	}
+
+public:
+	/**
+	 * look up the unexpired value of a key, return false if it has to be read from the server
+	 */
+	bool find(uint32_t key, float& value) const {
+		const slot& s = slots[index(key)];
+		if (s.key != key || age - s.stamp >= refresh) return false;
+		value = s.value;
+		return true;
+	}
+	void store(uint32_t key, float value) {
+		slots[index(key)] = { key, age, value };
+	}
+	/**
+	 * advance the clock by which the values expire
+	 */
+	void tick() { age++; }
+
+protected:
+	size_t index(uint32_t key) const {
+		return shift < 32 ? size_t(uint32_t(key * 0x9e3779b9u) >> shift) : 0;
+	}
+
+protected:
+	struct slot {
+		uint32_t key;
+		uint32_t stamp;
+		float value;
+	};
+	std::vector<slot> slots;
+	uint32_t age;
+	uint32_t refresh;
+	unsigned shift; // 32 minus the bits of the index, which takes the top bits of the hash
+};
+
+/**
+ * the connection of a worker to the parameter server, which may be shared by the copies of the
+ * worker (e.g., its threads), each of which reads the values into its own parameter_cache
+ *
+ * the values are read in batches of the keys missing from a cache, and the reply of every
+ * update message carries the new values of the updated keys, which refresh the hot entries
+ */
+class parameter_client {
+public:
+	parameter_client(const std::string& path) : fd(-1) {
+#ifdef PARAMETER_SERVER_SUPPORTED
+		sockaddr_un addr = parameter_server::address(path);
+		while (true) { // wait for the server to be up
+			fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd == -1) std::exit(-1);
+			if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) break;
+			close(fd);
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+#else
+		std::exit(-1);
+#endif
+	}
+	~parameter_client() {
+#ifdef PARAMETER_SERVER_SUPPORTED
+		if (fd != -1) close(fd);
+#endif
+	}
+	parameter_client(const parameter_client&) = delete;
+	parameter_client& operator =(const parameter_client&) = delete;
+
+public:
+	/**
+	 * query the number of tables and their span
+	 */
+	void layout(uint64_t& tables, uint64_t& span) {
+		std::lock_guard<std::mutex> lock(mutex);
+		parameter_protocol::header req = { parameter_protocol::layout, 0 };
+		uint64_t reply[2];
+		if (!parameter_protocol::send(fd, &req, sizeof(req)) || !parameter_protocol::receive(fd, reply, sizeof(reply))) std::exit(-1);
+		tables = reply[0];
+		span = reply[1];
+	}
+	/**
+	 * read the values of the keys from the server
+	 */
+	void read(const std::vector<uint32_t>& keys, std::vector<float>& values) {
+		std::lock_guard<std::mutex> lock(mutex);
+		parameter_protocol::header req = { parameter_protocol::read, uint32_t(keys.size()) };
+		values.resize(keys.size());
+		if (!parameter_protocol::send(fd, &req, sizeof(req))
+				|| !parameter_protocol::send(fd, keys.data(), sizeof(uint32_t) * keys.size())
+				|| !parameter_protocol::receive(fd, values.data(), sizeof(float) * values.size())) std::exit(-1);
+	}
+	/**
+	 * send the updates to the server, then store the new values of their keys into the cache
+	 * the buffer is consumed
+	 */
+	void push(update_buffer& updates, parameter_cache& cache) {
+		const std::vector<update>& records = updates.data();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			parameter_protocol::header req = { parameter_protocol::update, uint32_t(records.size()) };
+			values.resize(records.size());
+			if (!parameter_protocol::send(fd, &req, sizeof(req))
+					|| !parameter_protocol::send(fd, records.data(), sizeof(update) * records.size())
+					|| !parameter_protocol::receive(fd, values.data(), sizeof(float) * values.size())) std::exit(-1);
+			for (size_t i = 0; i < records.size(); i++) cache.store(records[i].key, values[i]);
+		}
+		updates.clear();
+	}
+
+protected:
+	int fd;
+	std::vector<float> values;
+	std::mutex mutex;
+};
@@ -0,0 +1,107 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * shard.h: Weight tables partitioned into shards with single-writer ownership
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "weight.h"
+#include "update.h"
+#include "precision.h"
+#include "queue.h"
+
+/**
+ * sharded ownership of the weight tables
+ *
+ * the key space of all tables (table * span + index) is split into contiguous index ranges,
+ * whose boundaries fall on the cache lines of the tables, i.e., the index of a boundary within
+ * its table is a multiple of the entries per line; each shard is owned by a thread, which is
+ * the only writer of its range and applies the updates sent to its lock-free inboxes
+ *
+ * every producer has its own inbox in each shard, and the owner drains the inboxes in a fixed
+ * producer order, so the updates from a producer are always applied in the order they are sent;
+ * however, the interleaving of the producers depends on timing, so the results of sharded
+ * training are not deterministic
+ */
+class shard_router {
+public:
+	shard_router(std::vector<weight>& net, std::vector<tc_table>& net_E, std::vector<tc_table>& net_A,
+			size_t span, size_t shards, size_t producers, size_t depth = 64)
+		: net(net), net_E(net_E), net_A(net_A), span(span), producers(producers), done(false) {
+		size_t keys = net.size() * span, line = 64 / std::min(sizeof(weight::type), sizeof(tc_type));
+		for (size_t s = 1; s < shards; s++) { // the first key of shard s, aligned within its table
+			size_t key = keys * s / shards, table = key / span, index = (key % span + line - 1) / line * line;
+			key = index < span ? table * span + index : (table + 1) * span;
+			bounds.push_back(std::max(key, bounds.empty() ? 0 : bounds.back()));
+		}
+		for (size_t s = 0; s < shards; s++) owners.emplace_back(new owner(producers, depth));
+		for (size_t s = 0; s < shards; s++) owners[s]->worker = std::thread(&shard_router::drain, this, s);
+	}
+	~shard_router() {
+		done = true;
+		for (auto& own : owners) own->worker.join();
+	}
+
+public:
+	/**
+	 * route the updates of a producer to the owning shards, then clear them
+	 * each shard receives a single message, which blocks while its inbox is full
+	 */
+	void send(size_t producer, update_buffer& updates) {
+		std::vector<std::vector<update>> parts(owners.size());
+		for (const update& u : updates.data()) parts[std::upper_bound(bounds.begin(), bounds.end(), u.key) - bounds.begin()].push_back(u);
+		updates.clear();
+		for (size_t s = 0; s < owners.size(); s++) {
+			if (parts[s].empty()) continue;
+			while (!owners[s]->inbox[producer]->push(std::move(parts[s]))) std::this_thread::yield();
+		}
+	}
+
+protected:
+	/**
+	 * the loop of a shard owner, which exits once stopped and all of its inboxes are empty
+	 */
+	void drain(size_t s) {
+		owner& own = *owners[s];
+		std::vector<update> message;
+		while (true) {
+			bool stop = done, idle = true;
+			for (size_t p = 0; p < producers; p++) {
+				while (own.inbox[p]->pop(message)) {
+					for (const update& u : message) own.pending.push(u);
+					idle = false;
+				}
+				own.pending.apply(net, net_E, net_A, span);
+			}
+			if (idle && stop) break;
+			if (idle) std::this_thread::yield();
+		}
+	}
+
+	struct owner {
+		owner(size_t producers, size_t depth) {
+			for (size_t p = 0; p < producers; p++)
+				inbox.emplace_back(new mpsc_queue<std::vector<update>>(depth));
+		}
+		std::vector<std::unique_ptr<mpsc_queue<std::vector<update>>>> inbox;
+		update_buffer pending;
+		std::thread worker;
+	};
+
+	std::vector<weight>& net;
+	std::vector<tc_table>& net_E;
+	std::vector<tc_table>& net_A;
+	size_t span;
+	std::vector<size_t> bounds; // the first key of each shard except the first one
+	size_t producers;
+	std::vector<std::unique_ptr<owner>> owners;
+	std::atomic<bool> done;
+};
@@ -0,0 +1,158 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * shm.h: Weight tables in a named shared memory segment
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include "weight.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SHARED_SEGMENT_SUPPORTED
+#endif
+
+/**
+ * a named POSIX shared memory segment (shm_open) holding weight tables,
+ * so that several processes can attach to the same tables and train them concurrently
+ *
+ * the layout is a header of the magic, the ready flag, the number of tables, their sizes and
+ * their element widths, followed by the tables, each aligned to cache lines; the creator fills the tables and then
+ * publishes the segment, while the others wait for it to be ready before attaching
+ */
+class shared_segment : public std::enable_shared_from_this<shared_segment> {
+public:
+	shared_segment(const std::string& name) : name(name), addr(nullptr), bytes(0) {}
+	~shared_segment() {
+#ifdef SHARED_SEGMENT_SUPPORTED
+		if (addr) munmap(addr, bytes);
+#endif
+	}
+
+public:
+	/**
+	 * attach to an existing segment, return false if there is no such segment
+	 */
+	bool attach() {
+#ifdef SHARED_SEGMENT_SUPPORTED
+		int fd = shm_open(name.c_str(), O_RDWR, 0600);
+		if (fd == -1) return false;
+		struct stat st;
+		while (fstat(fd, &st) == 0 && size_t(st.st_size) < sizeof(header)) // being created
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		bytes = st.st_size;
+		addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			addr = nullptr;
+			return false;
+		}
+		while (info().ready.load(std::memory_order_acquire) == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return info().magic == magic;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * create the segment exclusively for tables of the given sizes and element widths in bytes,
+	 * which are initialized to zero
+	 * return false if the segment cannot be created, e.g., it already exists
+	 */
+	bool create(const std::vector<uint64_t>& sizes, const std::vector<uint64_t>& widths) {
+#ifdef SHARED_SEGMENT_SUPPORTED
+		if (sizes.size() > max_tables || widths.size() != sizes.size()) return false;
+		int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1) return false;
+		bytes = sizeof(header);
+		for (size_t i = 0; i < sizes.size(); i++) bytes += align(sizes[i] * widths[i]);
+		if (ftruncate(fd, bytes) != 0) {
+			close(fd);
+			shm_unlink(name.c_str());
+			return false;
+		}
+		addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			addr = nullptr;
+			shm_unlink(name.c_str());
+			return false;
+		}
+		info().magic = magic;
+		info().count = sizes.size();
+		std::copy(sizes.begin(), sizes.end(), info().sizes);
+		std::copy(widths.begin(), widths.end(), info().widths);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * mark the segment as ready, after the creator has filled the tables
+	 */
+	void publish() {
+		if (addr) info().ready.store(1, std::memory_order_release);
+	}
+
+	size_t count() {
+		return addr ? info().count : 0;
+	}
+
+	/**
+	 * the tables [first, last) as views into the segment, which keep the segment mapped
+	 * return no views if the element widths do not match, e.g., the segment is created by a build
+	 * with another precision of the tables
+	 */
+	template<typename type>
+	std::vector<table<type>> tables(size_t first, size_t last) {
+		std::vector<table<type>> views;
+		if (!addr || last > info().count) return views;
+		char* data = static_cast<char*>(addr) + sizeof(header);
+		for (size_t i = 0; i < last; i++) {
+			if (i >= first && info().widths[i] != sizeof(type)) return {};
+			if (i >= first) views.emplace_back(reinterpret_cast<type*>(data), info().sizes[i], shared_from_this());
+			data += align(info().sizes[i] * info().widths[i]);
+		}
+		return views;
+	}
+
+	static void unlink(const std::string& name) {
+#ifdef SHARED_SEGMENT_SUPPORTED
+		shm_unlink(name.c_str());
+#endif
+	}
+
+protected:
+	static constexpr uint64_t magic = 0x3248535438343032ull; // "2048TSH2"
+	static constexpr size_t max_tables = 254;
+
+	struct header {
+		uint64_t magic;
+		std::atomic<uint64_t> ready;
+		uint64_t count;
+		uint64_t sizes[max_tables];
+		uint64_t widths[max_tables];
+		uint64_t reserved; // pad the header to 4096 bytes, so that the tables are aligned
+	};
+
+	header& info() { return *static_cast<header*>(addr); }
+	static size_t align(size_t size) { return (size + 63) & ~size_t(63); }
+
+	std::string name;
+	void* addr;
+	size_t bytes;
+};
@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <mutex>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
@@ -56,6 +57,7 @@ public:
 	 *  '22.4%': 22.4% (224 games) terminated with 8192-tiles (the largest)
 	 */
 	void show(bool tstat = true) const {
+		std::lock_guard<std::mutex> lock(output()); // keep the reports of concurrent runs apart
 		size_t blk = std::min(data.size(), block);
 		size_t stat[64] = { 0 };
 		size_t sop = 0, pop = 0, eop = 0;
@@ -78,7 +80,7 @@ public:
 		std::ios ff(nullptr);
 		ff.copyfmt(std::cout);
 		std::cout << std::fixed << std::setprecision(0);
-		std::cout << count << "\t";
+		std::cout << title << count << "\t";
 		std::cout << "avg = " << (sum / blk) << ", ";
 		std::cout << "max = " << (max) << ", ";
 		std::cout << "ops = " << (sop * 1000.0 / sdu);
@@ -110,9 +112,18 @@ public:
 		return count >= total;
 	}
 
+	/**
+	 * the oldest episode is recycled as the new one once the limit is reached, so that the
+	 * episodes and their moves are not reallocated for every game
+	 */
 	void open_episode(const std::string& flag = "") {
-		if (count++ >= limit) data.pop_front();
-		data.emplace_back();
+		if (data.size() && data.size() >= limit) {
+			data.splice(data.end(), data, data.begin());
+			data.back().clear();
+		} else {
+			data.emplace_back();
+		}
+		count++;
 		data.back().open_episode(flag);
 	}
 
@@ -121,6 +132,37 @@ public:
 		if (count % block == 0) show();
 	}
 
+	/**
+	 * record a finished episode which was played outside, e.g., by a worker thread
+	 */
+	void push_episode(episode&& ep) {
+		if (data.size() >= limit) data.pop_front();
+		count++;
+		data.push_back(std::move(ep));
+		if (count % block == 0) show();
+	}
+
+	/**
+	 * set the title printed before the index, e.g., to tell an evaluation from the training
+	 */
+	void label(const std::string& text) {
+		title = text;
+	}
+
+	/**
+	 * the number of episodes counted so far, which can be restored when resuming a training
+	 */
+	size_t episodes() const {
+		return count;
+	}
+	void resume(size_t episodes) {
+		count = episodes;
+	}
+
+	size_t remaining() const {
+		return total > count ? total - count : 0;
+	}
+
 	episode& at(size_t i) {
 		auto it = data.begin();
 		while (i--) it++;
@@ -148,6 +190,10 @@ public:
 	}
 
 private:
+	static std::mutex& output() { static std::mutex m; return m; }
+
+private:
+	std::string title;
 	size_t total;
 	size_t block;
 	size_t limit;
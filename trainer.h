@@ -0,0 +1,352 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * trainer.h: Parallel training loops for players with shared weight tables
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <functional>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "adversary.h"
+#include "episode.h"
+#include "statistic.h"
+#include "queue.h"
+#include "shard.h"
+#include "pool.h"
+
+class trainer {
+public:
+	trainer(player& play, const std::string& evil_args, statistic& stat, const std::function<void()>& observe = {})
+		: play(play), evil_args(evil_args), stat(stat), observe(observe), pool(nullptr) {}
+
+public:
+	/**
+	 * start the games from the pool of states, and harvest the recorded games into the pool
+	 */
+	void restart(start_pool& from) {
+		pool = &from;
+		pool->install();
+	}
+
+	/**
+	 * Hogwild-style self-play with multiple worker threads
+	 * each worker owns its player (search state and history) and its environment,
+	 * while the weight tables are shared and updated without any lock,
+	 * since the updates of an n-tuple network touch only a few sparse entries
+	 */
+	void hogwild(size_t threads) {
+		std::atomic<size_t> games(0);
+		size_t quota = stat.remaining();
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < threads; id++) {
+			workers.emplace_back([this, id, quota, &games]() {
+				player worker(play); // share the weight tables
+				std::unique_ptr<random_agent> evil = make_environment(environment(id), worker);
+				while (games++ < quota) {
+					episode game;
+					self_play(game, worker, *evil);
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	/**
+	 * reproducible self-play with multiple worker threads, where the same seed and number of
+	 * threads always give the same weights
+	 *
+	 * the games are played in epochs of E games on the weights left by the previous epoch:
+	 * game g is played by worker (g mod T) on the random stream of g derived from the seed,
+	 * the workers hold their updates, which are merged in the order of the workers at the end
+	 * of the epoch, and then the games are recorded in their order
+	 * E defaults to T; a long epoch hurts learning, as its games never see each other's updates
+	 */
+	void deterministic(size_t threads, size_t epoch) {
+		size_t quota = stat.remaining(), first = stat.episodes();
+		epoch = std::max(epoch, threads);
+		std::vector<std::unique_ptr<player>> players;
+		std::vector<std::unique_ptr<random_agent>> envs;
+		for (size_t id = 0; id < threads; id++) {
+			players.emplace_back(new player(play)); // share the weight tables
+			players.back()->hold_updates();
+			envs.emplace_back(make_environment(evil_args, *players.back()));
+		}
+		std::vector<episode> games(epoch);
+		for (size_t begin = 0; begin < quota; begin += epoch) {
+			size_t end = std::min(begin + epoch, quota);
+			std::vector<std::thread> workers;
+			for (size_t id = 0; id < threads; id++) {
+				workers.emplace_back([this, id, threads, begin, end, first, &players, &envs, &games]() {
+					player& worker = *players[id];
+					random_agent& evil = *envs[id];
+					for (size_t g = begin + id; g < end; g += threads) {
+						episode& game = games[g - begin];
+						game.clear();
+						evil.switch_stream(first + g);
+						std::string flag = play_game(game, worker, evil);
+						worker.close_episode(flag);
+						evil.close_episode(flag);
+					}
+				});
+			}
+			for (std::thread& worker : workers) worker.join();
+			for (auto& worker : players) worker->flush_updates();
+			for (size_t g = begin; g < end; g++) record(std::move(games[g - begin]));
+		}
+	}
+
+	/**
+	 * self-play with multiple worker threads as hogwild, but the tables are split into shards,
+	 * each of which is written only by its owner thread; the workers defer the updates of
+	 * each episode and send them to the inboxes of the owning shards
+	 */
+	void sharded(size_t threads, size_t shards) {
+		std::atomic<size_t> games(0);
+		size_t quota = stat.remaining();
+		shard_router router(play.tables(), play.tables_E(), play.tables_A(), map_size, shards, threads);
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < threads; id++) {
+			workers.emplace_back([this, id, quota, &games, &router]() {
+				player worker(play);
+				worker.redirect_updates([id, &router](update_buffer& updates) { router.send(id, updates); });
+				std::unique_ptr<random_agent> evil = make_environment(environment(id), worker);
+				while (games++ < quota) {
+					episode game;
+					self_play(game, worker, *evil);
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	/**
+	 * actor-learner pipeline, configured by "actor=N refresh=R queue=Q"
+	 * the actors play games with a snapshot of the value tables and push the compact action
+	 * records of finished games into a lock-free queue of depth Q, while the calling thread
+	 * is the only learner that applies the TD updates, free from update contention
+	 * the snapshot is refreshed from the learner every R learned games, or frozen if R is 0
+	 */
+	void pipeline(const std::string& args) {
+		std::map<std::string, std::string> opt = parse("actor=1 refresh=0 queue=64 " + args);
+		size_t actors = std::stoull(opt["actor"]), refresh = std::stoull(opt["refresh"]);
+		if (refresh == 0) refresh = -1ull;
+		mpsc_queue<std::pair<board, std::vector<unsigned>>> queue(std::stoull(opt["queue"]));
+
+		player snapshot(play);
+		snapshot.detach_weights();
+		std::atomic<size_t> games(0);
+		size_t quota = stat.remaining();
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < actors; id++) {
+			workers.emplace_back([this, id, quota, &games, &queue, &snapshot]() {
+				player actor(snapshot);
+				actor.freeze();
+				std::unique_ptr<random_agent> evil = make_environment(environment(id), actor);
+				while (games++ < quota) {
+					episode game;
+					std::string flag = play_game(game, actor, *evil);
+					std::vector<action> actions = game.actions();
+					std::pair<board, std::vector<unsigned>> moves(game.start(), { actions.begin(), actions.end() });
+					record(std::move(game), false);
+					actor.close_episode(flag);
+					evil->close_episode(flag);
+					while (!queue.push(std::move(moves))) std::this_thread::yield();
+				}
+			});
+		}
+		for (size_t learned = 0; learned < quota; ) {
+			std::pair<board, std::vector<unsigned>> moves;
+			if (!queue.pop(moves)) {
+				std::this_thread::yield();
+				continue;
+			}
+			play.learn_episode(moves.second, moves.first);
+			if (++learned % refresh == 0) snapshot.refresh_weights(play);
+			if (observe) observe();
+		}
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	/**
+	 * offline training from recorded games, e.g., those saved by --save
+	 * the worker threads take the given files one by one, rebuild the afterstates of each
+	 * recorded episode and apply the TD updates to the shared tables, without any search
+	 */
+	void replay(const std::vector<std::string>& files, size_t threads) {
+		std::atomic<size_t> next(0), episodes(0);
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < threads; id++) {
+			workers.emplace_back([this, &files, &next, &episodes]() {
+				player worker(play); // share the weight tables
+				for (size_t i; (i = next++) < files.size(); ) {
+					std::ifstream in(files[i], std::ios::in);
+					for (std::string line; std::getline(in, line); ) {
+						if (line.empty()) continue;
+						episode game;
+						std::stringstream(line) >> game;
+						std::vector<action> actions = game.actions();
+						worker.learn_episode(std::vector<unsigned>(actions.begin(), actions.end()), game.start());
+						episodes++;
+					}
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+		std::cout << "replay " << episodes << " episodes from " << files.size() << " files" << std::endl;
+	}
+
+protected:
+	/**
+	 * play a game and record it, then let both agents learn from it
+	 */
+	void self_play(episode& game, agent& play, agent& evil) {
+		std::string flag = play_game(game, play, evil);
+		record(std::move(game));
+
+		play.close_episode(flag);
+		evil.close_episode(flag);
+	}
+
+public:
+	/**
+	 * play a game between the agents, return the name of the winner
+	 */
+	static std::string play_game(episode& game, agent& play, agent& evil) {
+		play.open_episode("~:" + evil.name());
+		evil.open_episode(play.name() + ":~");
+
+		game.open_episode(play.name() + ":" + evil.name());
+		while (true) {
+			agent& who = game.take_turns(play, evil);
+			action move = who.take_action(game.state());
+			if (game.apply_action(move) != true) break;
+			if (who.check_for_win(game.state())) break;
+		}
+		agent& win = game.last_turns(play, evil);
+		game.close_episode(win.name());
+		return win.name();
+	}
+
+protected:
+	/**
+	 * record a finished game, and notify the observer unless the game is not learned yet
+	 */
+	void record(episode&& game, bool learned = true) {
+		std::lock_guard<std::mutex> lock(stat_mutex);
+		if (pool) pool->observe(game);
+		stat.push_episode(std::move(game));
+		if (learned && observe) observe();
+	}
+
+	/**
+	 * the environment arguments of a worker, where the first worker keeps the given seed
+	 * and the others derive their own random streams from it
+	 */
+	std::string environment(size_t id) const {
+		return id ? evil_args + " stream=" + std::to_string(id) : evil_args;
+	}
+
+	static std::map<std::string, std::string> parse(const std::string& args) {
+		std::map<std::string, std::string> opt;
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; )
+			opt[pair.substr(0, pair.find('='))] = pair.substr(pair.find('=') + 1);
+		return opt;
+	}
+
+protected:
+	player& play;
+	std::string evil_args;
+	statistic& stat;
+	std::function<void()> observe; // called after each recorded game
+	start_pool* pool; // harvests the recorded games, if any
+	std::mutex stat_mutex;
+};
+
+/**
+ * background evaluation on snapshots of the value tables, configured by
+ * "every=M total=N thread=T seed=S": after every M training games, a snapshot of the player
+ * is taken and N games are played with alpha=0 by T threads, while the training continues
+ * the result is reported through a statistic titled with the number of training games
+ * an interval is skipped if the previous evaluation is still running
+ */
+class evaluator {
+public:
+	evaluator(player& play, const std::string& args = "") : play(play), every(0), total(1000), threads(1), games(0), busy(false) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('=')), value = pair.substr(pair.find('=') + 1);
+			if (key == "every") every = std::stoull(value);
+			if (key == "total") total = std::stoull(value);
+			if (key == "thread") threads = std::max(std::stoull(value), 1ull);
+			if (key == "seed") evil_args = "seed=" + value;
+		}
+	}
+	~evaluator() {
+		if (runner.joinable()) runner.join();
+	}
+
+public:
+	/**
+	 * count a finished training game, and start an evaluation at the end of each interval
+	 * should be called by one thread at a time, which is not playing with the player
+	 */
+	void observe() {
+		if (!every || ++games % every || busy) return;
+		if (runner.joinable()) runner.join();
+		busy = true;
+		std::shared_ptr<player> snapshot(new player(play)); // shares the tables until detached
+		runner = std::thread(&evaluator::run, this, snapshot, games);
+	}
+
+protected:
+	void run(std::shared_ptr<player> snapshot, size_t at) {
+		snapshot->detach_weights();
+		snapshot->freeze();
+		snapshot->notify("alpha=0");
+		statistic result(total, total, total);
+		result.label("eval@" + std::to_string(at) + "\t");
+		std::mutex result_mutex;
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for (size_t id = 0; id < threads; id++) {
+			workers.emplace_back([this, id, &snapshot, &result, &result_mutex, &next]() {
+				player worker(*snapshot);
+				std::unique_ptr<random_agent> evil = make_environment(id ? evil_args + " stream=" + std::to_string(id) : evil_args, worker);
+				while (next++ < total) {
+					episode game((board())); // evaluate from the empty board regardless of the initial hook
+					std::string flag = trainer::play_game(game, worker, *evil);
+					worker.close_episode(flag);
+					std::lock_guard<std::mutex> lock(result_mutex);
+					result.push_episode(std::move(game));
+				}
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+		busy = false;
+	}
+
+protected:
+	player& play;
+	std::string evil_args;
+	size_t every;
+	size_t total;
+	size_t threads;
+	size_t games;
+	std::atomic<bool> busy;
+	std::thread runner;
+};
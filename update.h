@@ -0,0 +1,89 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * update.h: Deferred weight updates applied in address order
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include "weight.h"
+#include "precision.h"
+
+/**
+ * a deferred TC update of a weight entry
+ * the key addresses the entry as (table * span + index), where span is the size of a table
+ */
+struct update {
+	uint32_t key;
+	float step; // the scaled TD error to be applied with the TC learning rate
+	float delta; // the TD error accumulated into net_E
+	float error; // the absolute TD error accumulated into net_A
+};
+
+/**
+ * buffer of deferred updates
+ * the updates are collected instead of being scattered over the tables immediately,
+ * then sorted by address and applied in a single sweep
+ */
+class update_buffer {
+public:
+	update_buffer() {}
+
+public:
+	void push(uint32_t key, float step, float delta) {
+		records.push_back({ key, step, delta, std::fabs(delta) });
+	}
+	void push(const update& u) {
+		records.push_back(u);
+	}
+	size_t size() const { return records.size(); }
+	bool empty() const { return records.empty(); }
+	void clear() { records.clear(); }
+	const std::vector<update>& data() const { return records; }
+
+	/**
+	 * sort the records by key with an LSD radix sort
+	 * the sort is stable, so the records of the same key stay in their push order
+	 */
+	void sort() {
+		if (records.empty()) return;
+		uint32_t top = 0;
+		for (const update& u : records) top |= u.key;
+		buffer.resize(records.size());
+		for (unsigned shift = 0; shift < 32 && (top >> shift); shift += 8) {
+			size_t count[257] = { 0 };
+			for (const update& u : records) count[((u.key >> shift) & 0xff) + 1]++;
+			for (size_t d = 1; d < 257; d++) count[d] += count[d - 1];
+			for (const update& u : records) buffer[count[(u.key >> shift) & 0xff]++] = u;
+			records.swap(buffer);
+		}
+	}
+
+	/**
+	 * sort and apply all records in address order, then clear the buffer
+	 * the records of an entry are applied one after another in their push order, each with
+	 * the TC learning rate |E|/A taken before its own statistics are accumulated, so that
+	 * the damping of TC works within a batch as it does without batching
+	 */
+	void apply(std::vector<weight>& net, std::vector<tc_table>& net_E, std::vector<tc_table>& net_A, size_t span) {
+		sort();
+		for (const update& u : records) {
+			size_t t = u.key / span, i = u.key % span;
+			if (u.step) { // the records of skipped updates only carry the statistics
+				float learning_rate = std::fabs(net_E[t][i]) / net_A[t][i];
+				net[t][i] += u.step * learning_rate;
+			}
+			tc_accumulate(net_E[t][i], net_A[t][i], u.delta, u.error);
+		}
+		records.clear();
+	}
+
+protected:
+	std::vector<update> records;
+	std::vector<update> buffer;
+};
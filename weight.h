@@ -10,40 +10,99 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
 
-class weight {
+/**
+ * lookup table of a value type, which is stored as floats in files regardless of the value type
+ */
+template<typename value_type>
+class table {
 public:
-	typedef float type;
+	typedef value_type type;
 
 public:
-	weight() {}
-	weight(size_t len) : value(len) {}
-	weight(weight&& f) : value(std::move(f.value)) {}
-	weight(const weight& f) = default;
+	table() : length(0), value(nullptr) {}
+	table(size_t len) : length(len), store(allocate(len)), value(store.get()) {}
+	table(type* data, size_t len, const std::shared_ptr<void>& owner) : length(len), store(owner, data), value(data) {} // a view into storage kept alive by the owner
+	table(table&& f) noexcept : length(f.length), store(std::move(f.store)), value(f.value) { f.length = 0; f.value = nullptr; }
+	table(const table& f) : table(f.length) { std::copy(f.value, f.value + f.length, value); }
 
-	weight& operator =(const weight& f) = default;
+	table& operator =(const table& f) {
+		if (length != f.length) *this = table(f.length);
+		std::copy(f.value, f.value + f.length, value);
+		return *this;
+	}
+	table& operator =(table&& f) noexcept {
+		length = f.length; store = std::move(f.store); value = f.value;
+		f.length = 0; f.value = nullptr;
+		return *this;
+	}
 	type& operator[] (size_t i) { return value[i]; }
 	const type& operator[] (size_t i) const { return value[i]; }
-	size_t size() const { return value.size(); }
+	size_t size() const { return length; }
+	type* data() { return value; }
+	const type* data() const { return value; }
+
+	/**
+	 * let this table refer to the storage of another table instead of copying it
+	 * updates through either table are visible to both (used by lock-free workers)
+	 */
+	table& share(const table& f) {
+		length = f.length; store = f.store; value = f.value;
+		return *this;
+	}
 
 public:
-	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
-		auto& value = w.value;
-		uint64_t size = value.size();
+	friend std::ostream& operator <<(std::ostream& out, const table& w) {
+		uint64_t size = w.size();
 		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
-		out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * size);
+		if (std::is_same<type, float>::value) {
+			out.write(reinterpret_cast<const char*>(w.data()), sizeof(type) * size);
+			return out;
+		}
+		float chunk[4096];
+		for (size_t i = 0; i < size; i += 4096) {
+			size_t n = std::min(size - i, size_t(4096));
+			for (size_t k = 0; k < n; k++) chunk[k] = float(w[i + k]);
+			out.write(reinterpret_cast<const char*>(chunk), sizeof(float) * n);
+		}
 		return out;
 	}
-	friend std::istream& operator >>(std::istream& in, weight& w) {
-		auto& value = w.value;
+	friend std::istream& operator >>(std::istream& in, table& w) {
 		uint64_t size = 0;
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
-		value.resize(size);
-		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * size);
+		if (size != w.size()) w = table(size);
+		if (std::is_same<type, float>::value) {
+			in.read(reinterpret_cast<char*>(w.data()), sizeof(type) * size);
+			return in;
+		}
+		float chunk[4096];
+		for (size_t i = 0; i < size; i += 4096) {
+			size_t n = std::min(size - i, size_t(4096));
+			in.read(reinterpret_cast<char*>(chunk), sizeof(float) * n);
+			for (size_t k = 0; k < n; k++) w[i + k] = chunk[k];
+		}
 		return in;
 	}
 
 protected:
-	std::vector<type> value;
+	/**
+	 * allocate zero-initialized storage aligned to cache lines
+	 */
+	static std::shared_ptr<type> allocate(size_t len) {
+		std::shared_ptr<char> block(new char[sizeof(type) * len + 64](), std::default_delete<char[]>());
+		uintptr_t addr = reinterpret_cast<uintptr_t>(block.get());
+		return std::shared_ptr<type>(block, reinterpret_cast<type*>((addr + 63) & ~uintptr_t(63)));
+	}
+
+protected:
+	size_t length;
+	std::shared_ptr<type> store;
+	type* value;
 };
+
+typedef table<float> weight;